@@ -202,9 +202,13 @@ class Application(tornado.web.Application):
     def init_manager(self):
         self.manager = xdecoder.ResourceManager()
         self.manager.set_thread_pool_size(self.config["runtime"]["thread_pool_size"])
+        self.manager.set_batch_max_frames(self.config["runtime"]["batch_max_frames"])
+        self.manager.set_batch_max_delay(self.config["runtime"]["batch_max_delay_ms"])
 
         self.manager.set_beam(self.config["decoder"]["beam"])
         self.manager.set_max_active(self.config["decoder"]["max_active"])
+        self.manager.set_cutoff_bins(self.config["decoder"]["cutoff_bins"])
+        self.manager.set_use_huge_pages(self.config["decoder"]["use_huge_pages"])
         self.manager.set_acoustic_scale(self.config["decoder"]["acoustic_scale"])
         self.manager.set_skip(self.config["decoder"]["skip"])
         self.manager.set_max_batch_size(self.config["decoder"]["max_batch_size"])
@@ -7,12 +7,15 @@ module = Extension('_xdecoder',
                    language='c++',
                    sources=['resource-manager_wrap.cxx',
                             '../src/resource-manager.cc',
+                            '../src/batch-net.cc',
                             '../src/decodable.cc',
                             '../src/decode-task.cc',
                             '../src/faster-decoder.cc',
                             '../src/feature-pipeline.cc',
                             '../src/fft.cc',
                             '../src/fst.cc',
+                            '../src/compressed-fst.cc',
+                            '../src/huge-page.cc',
                             '../src/net.cc',
                             '../src/utils.cc',
                             '../src/vad.cc'],
@@ -0,0 +1,127 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "batch-decoder.h"
+
+namespace xdecoder {
+
+template <class FST>
+BatchDecoder::BatchDecoder(const FST& fst,
+                           const FasterDecoderOptions& decoder_options,
+                           const Tree& tree,
+                           const Vector<float>& pdf_prior,
+                           const DecodableOptions& decodable_options,
+                           const FeaturePipelineConfig& feature_options,
+                           const Net& net,
+                           int32_t num_streams):
+    net_(net), num_streams_(num_streams) {
+  CHECK(num_streams_ > 0);
+  for (int32_t i = 0; i < num_streams_; i++) {
+    FeaturePipeline* feature_pipeline = new FeaturePipeline(feature_options);
+    feature_pipelines_.push_back(feature_pipeline);
+    decodables_.push_back(new OnlineDecodable(tree, pdf_prior,
+        decodable_options, &net_, &workspace_, feature_pipeline));
+    decoders_.push_back(new FasterDecoder(fst, decoder_options));
+  }
+}
+
+template BatchDecoder::BatchDecoder(const Fst& fst,
+    const FasterDecoderOptions& decoder_options, const Tree& tree,
+    const Vector<float>& pdf_prior, const DecodableOptions& decodable_options,
+    const FeaturePipelineConfig& feature_options, const Net& net,
+    int32_t num_streams);
+template BatchDecoder::BatchDecoder(const CompressedFst& fst,
+    const FasterDecoderOptions& decoder_options, const Tree& tree,
+    const Vector<float>& pdf_prior, const DecodableOptions& decodable_options,
+    const FeaturePipelineConfig& feature_options, const Net& net,
+    int32_t num_streams);
+
+BatchDecoder::~BatchDecoder() {
+  for (int32_t i = 0; i < num_streams_; i++) {
+    delete decoders_[i];
+    delete decodables_[i];
+    delete feature_pipelines_[i];
+  }
+}
+
+void BatchDecoder::Decode(const std::vector<std::vector<float> >& wavs,
+                          std::vector<std::vector<int32_t> >* results) {
+  CHECK(results != NULL);
+  int32_t num_wavs = static_cast<int32_t>(wavs.size());
+  results->resize(num_wavs);
+  std::vector<int32_t> stream_wavs(num_streams_, -1);
+  int32_t next_wav = 0, num_finished = 0;
+  while (num_finished < num_wavs) {
+    // Refill the idle streams
+    for (int32_t i = 0; i < num_streams_ && next_wav < num_wavs; i++) {
+      if (stream_wavs[i] != -1) continue;
+      decodables_[i]->Reset();
+      decodables_[i]->AcceptRawWav(wavs[next_wav]);
+      decodables_[i]->SetDone();
+      decoders_[i]->InitDecoding();
+      stream_wavs[i] = next_wav++;
+    }
+    Step(stream_wavs);
+    for (int32_t i = 0; i < num_streams_; i++) {
+      if (stream_wavs[i] == -1 ||
+          decoders_[i]->NumFramesDecoded() < decodables_[i]->NumFramesReady())
+        continue;
+      decoders_[i]->GetBestPath(&(*results)[stream_wavs[i]]);
+      stream_wavs[i] = -1;
+      num_finished++;
+    }
+  }
+}
+
+void BatchDecoder::Step(const std::vector<int32_t>& stream_wavs) {
+  // streams[i] starts at frames[i], and takes rows[i] rows in the batch
+  std::vector<int32_t> streams, frames, rows;
+  int32_t total_rows = 0;
+  for (int32_t i = 0; i < num_streams_; i++) {
+    if (stream_wavs[i] == -1) continue;
+    int32_t frame = decoders_[i]->NumFramesDecoded();
+    if (frame >= decodables_[i]->NumFramesReady()) continue;
+    int32_t num_frames_forward = 0;
+    decodables_[i]->NumBatchFrames(frame, &num_frames_forward);
+    streams.push_back(i);
+    frames.push_back(frame);
+    rows.push_back(num_frames_forward);
+    total_rows += num_frames_forward;
+  }
+  if (streams.size() == 0) return;
+
+  batch_in_.Resize(total_rows, net_.InDim());
+  int32_t offset = 0;
+  for (size_t i = 0; i < streams.size(); i++) {
+    Matrix<float> in(batch_in_.Data() + offset * batch_in_.NumCols(),
+                     rows[i], batch_in_.NumCols());
+    decodables_[streams[i]]->ReadBatchInput(frames[i], &in);
+    offset += rows[i];
+  }
+  net_.Forward(batch_in_, &batch_out_, &workspace_);
+  offset = 0;
+  for (size_t i = 0; i < streams.size(); i++) {
+    OnlineDecodable* decodable = decodables_[streams[i]];
+    decodable->AcceptBatchOutput(frames[i],
+                                 batch_out_.RowRange(offset, rows[i]));
+    offset += rows[i];
+    // Only the frames computed above, so the decoder never forwards the
+    // net by itself
+    decoders_[streams[i]]->AdvanceDecoding(decodable,
+        decodable->NumBatchFrames(frames[i], NULL));
+  }
+}
+
+}  // namespace xdecoder
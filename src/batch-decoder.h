@@ -0,0 +1,75 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BATCH_DECODER_H_
+#define BATCH_DECODER_H_
+
+#include <vector>
+
+#include "decodable.h"
+#include "faster-decoder.h"
+#include "feature-pipeline.h"
+#include "fst.h"
+#include "net.h"
+#include "tree.h"
+
+namespace xdecoder {
+
+// BatchDecoder decodes N utterances in lockstep, for offline decoding.
+// In every step, the next batch of frames of all the busy streams is
+// forwarded by one big Net::Forward(), then every stream's FasterDecoder
+// advances over its own frames. A stream takes the next utterance as soon
+// as its current one is finished, so the batch stays full until the
+// utterances run out. Every stream has its own FasterDecoder, so its tokens
+// and hash elements live in its own pools.
+class BatchDecoder {
+ public:
+  // FST is Fst or CompressedFst
+  template <class FST>
+  BatchDecoder(const FST& fst,
+               const FasterDecoderOptions& decoder_options,
+               const Tree& tree,
+               const Vector<float>& pdf_prior,
+               const DecodableOptions& decodable_options,
+               const FeaturePipelineConfig& feature_options,
+               const Net& net,
+               int32_t num_streams);
+  ~BatchDecoder();
+
+  int32_t NumStreams() const { return num_streams_; }
+
+  // Decode all the wavs, results[i] is the result of wavs[i]
+  void Decode(const std::vector<std::vector<float> >& wavs,
+              std::vector<std::vector<int32_t> >* results);
+
+ private:
+  // stream_wavs[i] is the wav index stream i decodes, -1 if it is idle
+  // Forward the next batch of all the busy streams, and advance their
+  // decoders
+  void Step(const std::vector<int32_t>& stream_wavs);
+
+  const Net& net_;
+  int32_t num_streams_;
+  std::vector<FeaturePipeline*> feature_pipelines_;
+  std::vector<OnlineDecodable*> decodables_;
+  std::vector<FasterDecoder*> decoders_;
+  NetWorkspace workspace_;
+  Matrix<float> batch_in_, batch_out_;
+  DISALLOW_COPY_AND_ASSIGN(BatchDecoder);
+};
+
+}  // namespace xdecoder
+
+#endif  // BATCH_DECODER_H_
@@ -0,0 +1,214 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "batch-net.h"
+
+namespace xdecoder {
+
+static double ElapsedMs(const struct timeval& start) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - start.tv_sec) * 1000.0 +
+         (now.tv_usec - start.tv_usec) / 1000.0;
+}
+
+BatchNet::BatchNet(const Net& net, const BatchNetOptions& options):
+    net_(net), options_(options), pending_frames_(0), stop_(false),
+    num_batches_(0), num_requests_(0), num_frames_(0),
+    max_batch_requests_(0) {
+  CHECK(options_.max_batch_size > 0);
+  if (pthread_mutex_init(&mutex_, NULL) != 0) {
+    ERROR("mutex init error");
+  }
+  if (pthread_cond_init(&request_cond_, NULL) != 0) {
+    ERROR("cond init error");
+  }
+  if (pthread_create(&thread_, NULL, BatchNet::InferenceThread,
+                     reinterpret_cast<void *>(this)) != 0) {
+    ERROR("pthread create error");
+  }
+}
+
+BatchNet::~BatchNet() {
+  pthread_mutex_lock(&mutex_);
+  stop_ = true;
+  pthread_mutex_unlock(&mutex_);
+  pthread_cond_broadcast(&request_cond_);
+  pthread_join(thread_, NULL);
+  pthread_mutex_destroy(&mutex_);
+  pthread_cond_destroy(&request_cond_);
+  if (num_batches_ > 0) {
+    LOG("batches %ld requests %ld frames %ld, average batch size %f, "
+        "max requests per batch %d", num_batches_, num_requests_,
+        num_frames_, static_cast<float>(num_frames_) / num_batches_,
+        max_batch_requests_);
+  }
+}
+
+void BatchNet::Forward(const Matrix<float>& in, Matrix<float>* out,
+                       ThreadPool* thread_pool, Threadable* task) {
+  CHECK(out != NULL);
+  CHECK(thread_pool != NULL && task != NULL);
+  CHECK(in.NumRows() > 0);
+  CHECK(in.NumCols() == net_.InDim());
+  // Deleted by the inference thread when the task is rescheduled
+  Request* request = new Request();
+  request->in = &in;
+  request->out = out;
+  request->thread_pool = thread_pool;
+  request->task = task;
+  gettimeofday(&request->arrive_time, NULL);
+  pthread_mutex_lock(&mutex_);
+  CHECK(!stop_);
+  pending_.push_back(request);
+  pending_frames_ += in.NumRows();
+  pthread_mutex_unlock(&mutex_);
+  pthread_cond_signal(&request_cond_);
+}
+
+int64_t BatchNet::NumBatches() {
+  pthread_mutex_lock(&mutex_);
+  int64_t num_batches = num_batches_;
+  pthread_mutex_unlock(&mutex_);
+  return num_batches;
+}
+
+int64_t BatchNet::NumRequests() {
+  pthread_mutex_lock(&mutex_);
+  int64_t num_requests = num_requests_;
+  pthread_mutex_unlock(&mutex_);
+  return num_requests;
+}
+
+int32_t BatchNet::MaxBatchRequests() {
+  pthread_mutex_lock(&mutex_);
+  int32_t max_batch_requests = max_batch_requests_;
+  pthread_mutex_unlock(&mutex_);
+  return max_batch_requests;
+}
+
+void* BatchNet::InferenceThread(void* arg) {
+  BatchNet* batch_net = static_cast<BatchNet*>(arg);
+  batch_net->Run();
+  return NULL;
+}
+
+// Called with mutex_ locked
+bool BatchNet::WaitBatch() {
+  while (!stop_ && pending_.empty()) {
+    pthread_cond_wait(&request_cond_, &mutex_);
+  }
+  if (pending_.empty()) return false;
+  // Wait more requests until the batch is full or the deadline of the oldest
+  // request is reached
+  while (!stop_ && pending_frames_ < options_.max_batch_size) {
+    double left_ms = options_.max_delay_ms -
+                     ElapsedMs(pending_.front()->arrive_time);
+    if (left_ms <= 0) break;
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t nsec = now.tv_usec * 1000 + static_cast<int64_t>(left_ms * 1e6);
+    struct timespec deadline;
+    deadline.tv_sec = now.tv_sec + nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+    if (pthread_cond_timedwait(&request_cond_, &mutex_, &deadline) ==
+        ETIMEDOUT) {
+      break;
+    }
+  }
+  return true;
+}
+
+void BatchNet::Run() {
+  std::vector<Request*> batch;
+  for (;;) {
+    pthread_mutex_lock(&mutex_);
+    if (!WaitBatch()) {
+      pthread_mutex_unlock(&mutex_);
+      break;
+    }
+    // Take whole requests until the batch is full, at least one request
+    batch.clear();
+    int32_t num_frames = 0;
+    while (!pending_.empty()) {
+      Request* request = pending_.front();
+      int32_t rows = request->in->NumRows();
+      if (batch.size() > 0 && num_frames + rows > options_.max_batch_size)
+        break;
+      batch.push_back(request);
+      num_frames += rows;
+      pending_.pop_front();
+    }
+    pending_frames_ -= num_frames;
+    pthread_mutex_unlock(&mutex_);
+
+    ForwardBatch(batch);
+
+    pthread_mutex_lock(&mutex_);
+    num_batches_++;
+    num_requests_ += batch.size();
+    num_frames_ += num_frames;
+    max_batch_requests_ = std::max(max_batch_requests_,
+                                   static_cast<int32_t>(batch.size()));
+    pthread_mutex_unlock(&mutex_);
+    // The output is ready, the tasks go on with it in their thread pools
+    for (size_t i = 0; i < batch.size(); i++) {
+      batch[i]->thread_pool->AddTask(batch[i]->task);
+      delete batch[i];
+    }
+  }
+}
+
+void BatchNet::ForwardBatch(const std::vector<Request*>& batch) {
+  CHECK(batch.size() > 0);
+  // A single request, no gather and scatter
+  if (batch.size() == 1) {
+    net_.Forward(*(batch[0]->in), batch[0]->out, &workspace_);
+    return;
+  }
+  int32_t in_dim = net_.InDim(), num_frames = 0;
+  for (size_t i = 0; i < batch.size(); i++) {
+    num_frames += batch[i]->in->NumRows();
+  }
+  // gather
+  batch_in_.Resize(num_frames, in_dim);
+  int32_t offset = 0;
+  for (size_t i = 0; i < batch.size(); i++) {
+    const Matrix<float>& in = *(batch[i]->in);
+    memcpy(batch_in_.Row(offset).Data(), in.Data(),
+           sizeof(float) * in.NumRows() * in_dim);
+    offset += in.NumRows();
+  }
+  net_.Forward(batch_in_, &batch_out_, &workspace_);
+  // scatter
+  int32_t out_dim = batch_out_.NumCols();
+  offset = 0;
+  for (size_t i = 0; i < batch.size(); i++) {
+    int32_t rows = batch[i]->in->NumRows();
+    Matrix<float>* out = batch[i]->out;
+    out->Resize(rows, out_dim);
+    memcpy(out->Data(), batch_out_.Row(offset).Data(),
+           sizeof(float) * rows * out_dim);
+    offset += rows;
+  }
+}
+
+}  // namespace xdecoder
@@ -0,0 +1,97 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BATCH_NET_H_
+#define BATCH_NET_H_
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <deque>
+
+#include "net.h"
+#include "thread-pool.h"
+
+namespace xdecoder {
+
+struct BatchNetOptions {
+  // Forward as soon as this many frames are pending
+  int32_t max_batch_size;
+  // Or when the oldest request has waited this long
+  float max_delay_ms;
+  BatchNetOptions(): max_batch_size(256), max_delay_ms(5.0f) {}
+};
+
+// BatchNet is a central inference stage shared by all the sessions. Small
+// Forward() requests from many tasks are coalesced into one big batch by an
+// inference thread, which does one Net::Forward(), scatters the output rows
+// back to the requesters and puts the requesting tasks back to their thread
+// pool, so we get big GEMMs instead of many tiny ones under load. Forward()
+// doesn't wait, the worker is free for other tasks meanwhile, so a batch is
+// not limited by the number of workers.
+class BatchNet {
+ public:
+  BatchNet(const Net& net, const BatchNetOptions& options);
+  // The pending requests are still forwarded, and their tasks rescheduled
+  ~BatchNet();
+  // Thread safe, returns at once. When out is ready, task is added to
+  // thread_pool, in and out must be kept until then.
+  void Forward(const Matrix<float>& in, Matrix<float>* out,
+               ThreadPool* thread_pool, Threadable* task);
+  int32_t InDim() const { return net_.InDim(); }
+  int32_t OutDim() const { return net_.OutDim(); }
+
+  // Statistics
+  int64_t NumBatches();
+  int64_t NumRequests();
+  // Most requests in one batch
+  int32_t MaxBatchRequests();
+
+ private:
+  struct Request {
+    const Matrix<float>* in;
+    Matrix<float>* out;
+    ThreadPool* thread_pool;
+    Threadable* task;
+    struct timeval arrive_time;
+  };
+
+  static void* InferenceThread(void* arg);
+  void Run();
+  // Wait until a batch is ready, return false if stopped
+  bool WaitBatch();
+  void ForwardBatch(const std::vector<Request*>& batch);
+
+  const Net& net_;
+  const BatchNetOptions& options_;
+  NetWorkspace workspace_;
+  Matrix<float> batch_in_, batch_out_;
+
+  std::deque<Request*> pending_;
+  int32_t pending_frames_;
+  bool stop_;
+  pthread_t thread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t request_cond_;  // new request arrives
+
+  // Statistics, guarded by mutex_
+  int64_t num_batches_, num_requests_, num_frames_;
+  int32_t max_batch_requests_;
+  DISALLOW_COPY_AND_ASSIGN(BatchNet);
+};
+
+}  // namespace xdecoder
+
+#endif  // BATCH_NET_H_
@@ -0,0 +1,237 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+#include "compressed-fst.h"
+
+namespace xdecoder {
+
+void CompressedFst::Reset() {
+  start_ = 0;
+  num_states_ = num_arcs_ = num_finals_ = num_olabels_ = 0;
+  weight_min_ = 0.0f;
+  weight_step_ = 1.0f;
+  data_size_ = 0;
+  own_arc_offset_.assign(1, 0);
+  own_byte_offset_.assign(1, 0);
+  own_finals_.clear();
+  own_olabels_.clear();
+  own_data_.clear();
+  arc_offset_ = own_arc_offset_.data();
+  byte_offset_ = own_byte_offset_.data();
+  finals_ = NULL;
+  olabels_ = NULL;
+  data_ = NULL;
+  mapped_file_.Unmap();
+}
+
+static void AppendVarint(uint32_t value, HugePageVector<uint8_t> *data) {
+  uint8_t bytes[kMaxVarint32Bytes];
+  uint8_t *end = Varint::WriteVarint32ToArray(value, bytes);
+  data->insert(data->end(), bytes, end);
+}
+
+void CompressedFst::AppendArc(const Fst& fst, int32_t state, const Arc& arc,
+                              bool eps, HugePageVector<uint8_t> *data) {
+  uint16_t weight = static_cast<uint16_t>(
+      lrintf((arc.weight - weight_min_) / weight_step_));
+  uint8_t bytes[sizeof(weight)];
+  memcpy(bytes, &weight, sizeof(weight));
+  data->insert(data->end(), bytes, bytes + sizeof(weight));
+  if (!eps) AppendVarint(arc.ilabel, data);
+  AppendVarint(Varint::Int32ToZigzag(arc.next_state - state), data);
+  if (arc.olabel != 0) {
+    OLabelEntry entry = { fst.ArcIndex(&arc), arc.olabel };
+    own_olabels_.push_back(entry);
+  }
+}
+
+void CompressedFst::Init(const Fst& fst) {
+  Reset();
+  start_ = fst.Start();
+  num_states_ = fst.NumStates();
+  num_arcs_ = fst.NumArcs();
+
+  weight_min_ = std::numeric_limits<float>::max();
+  float weight_max = -std::numeric_limits<float>::max();
+  for (int32_t i = 0; i < num_arcs_; i++) {
+    float weight = fst.GetArc(i).weight;
+    CHECK(weight == weight && !isinf(weight));
+    weight_min_ = std::min(weight_min_, weight);
+    weight_max = std::max(weight_max, weight);
+  }
+  if (num_arcs_ == 0) weight_min_ = weight_max = 0.0f;
+  weight_step_ = (weight_max - weight_min_) / 65535;
+  if (weight_step_ == 0.0f) weight_step_ = 1.0f;
+
+  own_arc_offset_.resize(num_states_ + 1);
+  own_byte_offset_.resize(num_states_ + 1);
+  own_finals_.resize(num_states_);
+  HugePageVector<uint8_t> eps_data;  // epsilon arcs of the state
+  for (int32_t s = 0; s < num_states_; s++) {
+    own_arc_offset_[s] = fst.ArcIndex(fst.ArcStart(s));
+    own_byte_offset_[s] = own_data_.size();
+    own_finals_[s] = fst.Final(s);
+    eps_data.clear();
+    ArcRange eps_arcs = fst.EpsArcs(s);
+    for (const Arc *arc = eps_arcs.begin(); arc != eps_arcs.end(); arc++) {
+      AppendArc(fst, s, *arc, true, &eps_data);
+    }
+    AppendVarint(eps_arcs.size(), &own_data_);
+    if (eps_arcs.size() > 0) {
+      AppendVarint(eps_data.size(), &own_data_);
+      own_data_.insert(own_data_.end(), eps_data.begin(), eps_data.end());
+    }
+    ArcRange arcs = fst.EmittingArcs(s);
+    for (const Arc *arc = arcs.begin(); arc != arcs.end(); arc++) {
+      AppendArc(fst, s, *arc, false, &own_data_);
+    }
+  }
+  own_arc_offset_[num_states_] = num_arcs_;
+  own_byte_offset_[num_states_] = own_data_.size();
+
+  num_finals_ = fst.NumFinals();
+  num_olabels_ = own_olabels_.size();
+  data_size_ = own_data_.size();
+  arc_offset_ = own_arc_offset_.data();
+  byte_offset_ = own_byte_offset_.data();
+  finals_ = own_finals_.data();
+  olabels_ = own_olabels_.data();
+  data_ = own_data_.data();
+}
+
+int32_t CompressedFst::MaxIlabel() const {
+  int32_t max_ilabel = 0;
+  for (int32_t i = 0; i < num_states_; i++) {
+    for (ArcIterator aiter(*this, i, false); !aiter.Done(); aiter.Next()) {
+      max_ilabel = std::max(max_ilabel, aiter.Value().ilabel);
+    }
+  }
+  return max_ilabel;
+}
+
+bool CompressedFst::IsCompressedFst(const std::string& file) {
+  std::ifstream is(file, std::ifstream::binary);
+  char magic[sizeof(kCompressedFstMagic)] = {0};
+  is.read(magic, sizeof(magic));
+  return !is.fail() &&
+         memcmp(magic, kCompressedFstMagic, sizeof(magic)) == 0;
+}
+
+void CompressedFst::Read(const std::string& filename) {
+  Reset();
+  mapped_file_.Map(filename);
+  if (mapped_file_.Size() < sizeof(CompressedFstHeader)) {
+    ERROR("file %s is not a compressed fst, check!!!", filename.c_str());
+  }
+  const char *data = mapped_file_.Data();
+  const CompressedFstHeader *header =
+      reinterpret_cast<const CompressedFstHeader *>(data);
+  if (memcmp(header->magic, kCompressedFstMagic,
+             sizeof(kCompressedFstMagic)) != 0) {
+    ERROR("file %s is not a compressed fst, check!!!", filename.c_str());
+  }
+  if (header->version != kCompressedFstVersion) {
+    ERROR("compressed fst %s version %d, expected %d", filename.c_str(),
+          header->version, kCompressedFstVersion);
+  }
+  CHECK(header->file_size == static_cast<int64_t>(mapped_file_.Size()));
+  // A corrupt header must not point outside the mapping, see Fst::Read()
+  CHECK(header->num_states >= 0 && header->num_arcs >= 0 &&
+        header->num_finals >= 0 && header->num_olabels >= 0);
+  CHECK(header->start >= 0 &&
+        (header->start < header->num_states || header->num_states == 0));
+  int64_t arc_offset_size = sizeof(int32_t) * (header->num_states + 1),
+          byte_offset_size = sizeof(int64_t) * (header->num_states + 1),
+          finals_size = sizeof(float) * header->num_states,
+          olabels_size = sizeof(OLabelEntry) * header->num_olabels;
+  CHECK(IsValidSection(header->arc_offset_pos, arc_offset_size,
+                       header->file_size));
+  CHECK(IsValidSection(header->byte_offset_pos, byte_offset_size,
+                       header->file_size));
+  CHECK(IsValidSection(header->finals_pos, finals_size, header->file_size));
+  CHECK(IsValidSection(header->olabels_pos, olabels_size,
+                       header->file_size));
+  CHECK(IsValidSection(header->data_pos, header->data_size,
+                       header->file_size));
+  start_ = header->start;
+  num_states_ = header->num_states;
+  num_arcs_ = header->num_arcs;
+  num_finals_ = header->num_finals;
+  num_olabels_ = header->num_olabels;
+  weight_min_ = header->weight_min;
+  weight_step_ = header->weight_step;
+  data_size_ = header->data_size;
+  arc_offset_ = reinterpret_cast<const int32_t *>(
+      data + header->arc_offset_pos);
+  byte_offset_ = reinterpret_cast<const int64_t *>(
+      data + header->byte_offset_pos);
+  finals_ = reinterpret_cast<const float *>(data + header->finals_pos);
+  olabels_ = reinterpret_cast<const OLabelEntry *>(
+      data + header->olabels_pos);
+  data_ = reinterpret_cast<const uint8_t *>(data + header->data_pos);
+  // The arcs of the last state end in the stream, so the varint decoder
+  // stays inside the mapping
+  CHECK(arc_offset_[num_states_] == num_arcs_);
+  CHECK(byte_offset_[num_states_] <= data_size_);
+}
+
+void CompressedFst::Write(const std::string& filename) const {
+  std::ofstream os(filename, std::ofstream::binary);
+  if (os.fail()) {
+    ERROR("write file %s error, check!!!", filename.c_str());
+  }
+
+  CompressedFstHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCompressedFstMagic, sizeof(kCompressedFstMagic));
+  header.version = kCompressedFstVersion;
+  header.start = start_;
+  header.num_states = num_states_;
+  header.num_arcs = num_arcs_;
+  header.num_finals = num_finals_;
+  header.num_olabels = num_olabels_;
+  header.weight_min = weight_min_;
+  header.weight_step = weight_step_;
+  header.data_size = data_size_;
+  int64_t arc_offset_size = sizeof(int32_t) * (num_states_ + 1),
+          byte_offset_size = sizeof(int64_t) * (num_states_ + 1),
+          finals_size = sizeof(float) * num_states_,
+          olabels_size = sizeof(OLabelEntry) * num_olabels_;
+  header.arc_offset_pos = AlignSection(sizeof(header));
+  header.byte_offset_pos = AlignSection(header.arc_offset_pos +
+                                        arc_offset_size);
+  header.finals_pos = AlignSection(header.byte_offset_pos + byte_offset_size);
+  header.olabels_pos = AlignSection(header.finals_pos + finals_size);
+  header.data_pos = AlignSection(header.olabels_pos + olabels_size);
+  header.file_size = header.data_pos + data_size_;
+
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  WriteSection(os, header.arc_offset_pos, arc_offset_, arc_offset_size);
+  WriteSection(os, header.byte_offset_pos, byte_offset_, byte_offset_size);
+  WriteSection(os, header.finals_pos, finals_, finals_size);
+  WriteSection(os, header.olabels_pos, olabels_, olabels_size);
+  WriteSection(os, header.data_pos, data_, data_size_);
+  if (os.fail()) {
+    ERROR("write file %s error, check!!!", filename.c_str());
+  }
+}
+
+}  // namespace xdecoder
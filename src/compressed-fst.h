@@ -0,0 +1,216 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPRESSED_FST_H_
+#define COMPRESSED_FST_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "fst.h"
+#include "mapped-file.h"
+#include "huge-page.h"
+#include "varint.h"
+
+namespace xdecoder {
+
+// Arc index and olabel of an arc whose olabel is not epsilon
+struct OLabelEntry {
+  int32_t arc_index;
+  int32_t olabel;
+  bool operator< (const OLabelEntry &other) const {
+    return arc_index < other.arc_index;
+  }
+};
+
+// The binary format of CompressedFst, mapped like Fst
+const char kCompressedFstMagic[8] = "xdcfst";
+const int32_t kCompressedFstVersion = 2;
+
+struct CompressedFstHeader {
+  char magic[8];
+  int32_t version;
+  int32_t start;
+  int32_t num_states;
+  int32_t num_arcs;
+  int32_t num_finals;
+  int32_t num_olabels;
+  float weight_min;
+  float weight_step;
+  // byte position of every section in the file
+  int64_t arc_offset_pos;
+  int64_t byte_offset_pos;
+  int64_t finals_pos;
+  int64_t olabels_pos;
+  int64_t data_pos;
+  int64_t data_size;
+  int64_t file_size;
+};
+
+// CompressedFst stores the arcs of Fst in a byte stream, it takes roughly
+// half of the memory of Fst for HCLG graphs.
+// The arcs of a state are encoded as:
+//   varint num_eps_arcs, [varint eps_bytes if num_eps_arcs > 0]
+//   epsilon arcs:  uint16 weight, varint zigzag(next_state - state)
+//   emitting arcs: uint16 weight, varint ilabel, varint zigzag(...)
+// eps_bytes is the size of the epsilon arcs, so the emitting arcs can be
+// visited directly. Weights are linearly quantized to 16 bits between the
+// min and max arc weight. Olabels are not in the stream, most of them are
+// epsilon, the others are in a table sorted by arc index, which is only
+// searched on traceback, see OLabel().
+class CompressedFst {
+ public:
+  CompressedFst() {
+    Reset();
+  }
+  explicit CompressedFst(const std::string& file) {
+    Reset();
+    Read(file);
+  }
+  void Reset();
+
+  // Compresses fst
+  void Init(const Fst& fst);
+
+  // Whether the file is a CompressedFst rather than a Fst
+  static bool IsCompressedFst(const std::string& file);
+
+  void Read(const std::string& file);
+  void Write(const std::string& file) const;
+  // See Fst::MaxIlabel()
+  int32_t MaxIlabel() const;
+
+  int32_t Start() const { return start_; }
+  int32_t NumStates() const { return num_states_; }
+  int32_t NumArcs() const { return num_arcs_; }
+  int32_t NumFinals() const { return num_finals_; }
+
+  bool IsFinal(int32_t id) const {
+    return finals_[id] != kNonFinalWeight;
+  }
+
+  // kNonFinalWeight if id is not final, see Fst::Final()
+  float Final(int32_t id) const {
+    return finals_[id];
+  }
+
+  int32_t NumArcs(int32_t id) const {
+    return arc_offset_[id + 1] - arc_offset_[id];
+  }
+
+  // Olabel of the arc_index-th arc
+  int32_t OLabel(int32_t arc_index) const {
+    const OLabelEntry *end = olabels_ + num_olabels_;
+    OLabelEntry key = { arc_index, 0 };
+    const OLabelEntry *it = std::lower_bound(olabels_, end, key);
+    return (it != end && it->arc_index == arc_index) ? it->olabel : 0;
+  }
+
+  // Bytes used by the arcs, including the olabel table and offsets
+  int64_t ArcBytes() const {
+    return data_size_ + sizeof(OLabelEntry) * num_olabels_ +
+           (sizeof(int32_t) + sizeof(int64_t)) * (num_states_ + 1);
+  }
+
+  // See Fst::HugePageReport()
+  std::string HugePageReport() const {
+    return xdecoder::HugePageReport("compressed fst arcs", data_,
+                                    data_size_);
+  }
+
+  // See Fst::ArcIterator, Value() has no olabel, use OLabel(Index())
+  class ArcIterator {
+   public:
+    ArcIterator(const CompressedFst& fst, int32_t state, bool eps):
+        state_(state), eps_(eps), weight_min_(fst.weight_min_),
+        weight_step_(fst.weight_step_) {
+      p_ = fst.data_ + fst.byte_offset_[state];
+      uint32_t num_eps = 0, eps_bytes = 0;
+      p_ = Varint::ReadUint32FromArray(p_, &num_eps);
+      if (num_eps > 0) p_ = Varint::ReadUint32FromArray(p_, &eps_bytes);
+      index_ = fst.arc_offset_[state];
+      if (eps) {
+        remaining_ = num_eps;
+      } else {
+        p_ += eps_bytes;
+        index_ += num_eps;
+        remaining_ = fst.arc_offset_[state + 1] - index_;
+      }
+      if (remaining_ > 0) Decode();
+    }
+    bool Done() const { return remaining_ == 0; }
+    void Next() {
+      remaining_--;
+      index_++;
+      if (remaining_ > 0) Decode();
+    }
+    const Arc& Value() const { return arc_; }
+    int32_t Index() const { return index_; }
+
+   private:
+    inline void Decode() {
+      uint16_t weight;
+      memcpy(&weight, p_, sizeof(weight));
+      p_ += sizeof(weight);
+      arc_.weight = weight_min_ + weight * weight_step_;
+      uint32_t value;
+      if (!eps_) {
+        p_ = Varint::ReadUint32FromArray(p_, &value);
+        arc_.ilabel = value;
+      }
+      p_ = Varint::ReadUint32FromArray(p_, &value);
+      arc_.next_state = state_ + Varint::ZigzagToInt32(value);
+    }
+
+    const uint8_t *p_;
+    int32_t state_;
+    bool eps_;
+    float weight_min_, weight_step_;
+    int32_t index_, remaining_;
+    Arc arc_;
+  };
+
+ private:
+  // Encodes arc of state to data, and its olabel to own_olabels_
+  void AppendArc(const Fst& fst, int32_t state, const Arc& arc, bool eps,
+                 HugePageVector<uint8_t> *data);
+
+  int32_t start_;
+  int32_t num_states_, num_arcs_, num_finals_, num_olabels_;
+  float weight_min_, weight_step_;
+  int64_t data_size_;
+  // Read-only views, into the own_* buffers or the mapped file like Fst
+  const int32_t *arc_offset_;  // first arc index of state, num_states_ + 1
+  const int64_t *byte_offset_;  // position in data_ of state, num_states_ + 1
+  const float *finals_;  // final weight of state
+  const OLabelEntry *olabels_;
+  const uint8_t *data_;
+
+  HugePageVector<int32_t> own_arc_offset_;
+  HugePageVector<int64_t> own_byte_offset_;
+  HugePageVector<float> own_finals_;
+  HugePageVector<OLabelEntry> own_olabels_;
+  HugePageVector<uint8_t> own_data_;
+
+  MappedFile mapped_file_;
+  DISALLOW_COPY_AND_ASSIGN(CompressedFst);
+};
+
+}  // namespace xdecoder
+
+#endif  // COMPRESSED_FST_H_
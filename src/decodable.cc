@@ -27,15 +27,42 @@ float OnlineDecodable::LogLikelihood(int32_t frame, int32_t index) {
   return scaled_loglikes_(frame - begin_frame_, pdf_id);
 }
 
+const float *OnlineDecodable::FrameCosts(int32_t frame) {
+  if (frame == costs_frame_) return costs_.data();
+  ComputeForFrame(frame);
+  const float *loglikes = scaled_loglikes_.Data() +
+                          (frame - begin_frame_) * scaled_loglikes_.NumCols();
+  const std::vector<int32_t>& pdf_of_tid = tree_.TransitionIdToPdfTable();
+  int32_t num_transition_ids = static_cast<int32_t>(pdf_of_tid.size());
+  costs_.resize(num_transition_ids);
+  for (int32_t i = 0; i < num_transition_ids; i++) {
+    costs_[i] = -loglikes[pdf_of_tid[i]];
+  }
+  costs_frame_ = frame;
+  return costs_.data();
+}
+
 void OnlineDecodable::ComputeForFrame(int32_t frame) {
   CHECK(frame >= 0);
-  int32_t features_ready = NumFramesReady();
-  CHECK(frame < features_ready);
+  CHECK(frame < NumFramesReady());
 
   if (frame >= begin_frame_ &&
       frame < begin_frame_ + scaled_loglikes_.NumRows())
     return;
 
+  int32_t num_frames_forward = 0;
+  NumBatchFrames(frame, &num_frames_forward);
+  Matrix<float> in(num_frames_forward, feature_pipeline_->FeatureDim()),
+                out(num_frames_forward, net_->OutDim());
+  ReadBatchInput(frame, &in);
+  CHECK(workspace_ != NULL);
+  net_->Forward(in, &out, workspace_);
+  AcceptBatchOutput(frame, out);
+}
+
+int32_t OnlineDecodable::NumBatchFrames(int32_t frame,
+                                       int32_t *num_frames_forward) const {
+  int32_t features_ready = NumFramesReady();
   int32_t input_frame_begin = frame;
   int32_t max_possible_input_frame_end = features_ready;
   int32_t shift = options_.skip + 1, batch_size = options_.max_batch_size;
@@ -43,18 +70,30 @@ void OnlineDecodable::ComputeForFrame(int32_t frame) {
                           input_frame_begin + batch_size * shift);
 
   CHECK(input_frame_end > input_frame_begin);
-  int32_t feat_dim = feature_pipeline_->FeatureDim();
   int32_t num_frames_out = (input_frame_end - input_frame_begin);
-  int32_t num_frames_forward = (num_frames_out - 1) / shift + 1;
+  if (num_frames_forward != NULL)
+    *num_frames_forward = (num_frames_out - 1) / shift + 1;
+  return num_frames_out;
+}
 
+void OnlineDecodable::ReadBatchInput(int32_t frame, Matrix<float> *in) {
+  int32_t num_frames_forward = 0;
+  NumBatchFrames(frame, &num_frames_forward);
+  int32_t shift = options_.skip + 1;
+  int32_t feat_dim = feature_pipeline_->FeatureDim();
   CHECK(feat_dim == net_->InDim());
-  Matrix<float> in(num_frames_forward, feat_dim),
-                out(num_frames_forward, net_->OutDim());
+  CHECK(in->NumRows() == num_frames_forward && in->NumCols() == feat_dim);
   for (int i = 0; i < num_frames_forward; i++) {
-    feature_pipeline_->ReadOneFrame(input_frame_begin + i * shift,
-                                    in.Row(i).Data());
+    feature_pipeline_->ReadOneFrame(frame + i * shift, in->Row(i).Data());
   }
-  net_->Forward(in, &out);
+}
+
+void OnlineDecodable::AcceptBatchOutput(int32_t frame,
+                                        const Matrix<float>& out) {
+  int32_t num_frames_forward = 0;
+  int32_t num_frames_out = NumBatchFrames(frame, &num_frames_forward);
+  int32_t shift = options_.skip + 1;
+  CHECK(out.NumRows() == num_frames_forward);
   scaled_loglikes_.Resize(num_frames_out, net_->OutDim());
   for (int i = 0; i < num_frames_forward; i++) {
     for (int j = 0; j < shift; j++) {
@@ -32,6 +32,11 @@ class Decodable {
   /// returns false before calling this.
   virtual float LogLikelihood(int32_t frame, int32_t index) = 0;
 
+  /// Returns the acoustic costs (negated log likelihoods) of all the indices
+  /// of the frame in a dense array, so the decoder can look them up without
+  /// a virtual call per arc. The array is valid until the next call.
+  virtual const float *FrameCosts(int32_t frame) = 0;
+
   /// Returns true if this is the last frame.  Frames are zero-based, so the
   /// first frame is zero.  IsLastFrame(-1) will return false, unless the file
   /// is empty (which is a case that I'm not sure all the code will handle, so
@@ -74,14 +79,17 @@ class OnlineDecodable : public Decodable {
   OnlineDecodable(const Tree& tree,
                   const Vector<float>& pdf_prior,
                   const DecodableOptions& options,
-                  Net *net,
+                  const Net *net,
+                  NetWorkspace *workspace,
                   FeaturePipeline *feature_pipeline):
       tree_(tree),
       pdf_prior_(pdf_prior),
       options_(options),
       net_(net),
+      workspace_(workspace),
       feature_pipeline_(feature_pipeline),
-      begin_frame_(0) {
+      begin_frame_(0),
+      costs_frame_(-1) {
     // Last softmax is unneccesary for decoding, and we can make the decoding
     // more fast by drop the last softmax. So we don't allow softmax in AM net,
     // and we don't deal with that case in decoding. please remove the last
@@ -89,6 +97,11 @@ class OnlineDecodable : public Decodable {
     // python tools/convert_kaldi_nnet1_model.py --remove-last-softmax
     CHECK(!net_->IsLastLayerSoftmax() &&
           "Last softmax is unneccesary for decoding, please remove it");
+    // Checked once here, so FrameCosts() indexes the table without checks
+    const std::vector<int32_t>& pdf_of_tid = tree_.TransitionIdToPdfTable();
+    for (size_t i = 0; i < pdf_of_tid.size(); i++) {
+      CHECK(pdf_of_tid[i] >= 0 && pdf_of_tid[i] < net_->OutDim());
+    }
   }
 
   virtual bool IsLastFrame(int32_t frame) const {
@@ -101,8 +114,12 @@ class OnlineDecodable : public Decodable {
 
   virtual float LogLikelihood(int32_t frame, int32_t index);
 
+  // Indexed by transition id
+  virtual const float *FrameCosts(int32_t frame);
+
   virtual void Reset() {
     begin_frame_ = 0;
+    costs_frame_ = -1;
     feature_pipeline_->Reset();
     scaled_loglikes_.Resize(0, 0);
   }
@@ -115,6 +132,21 @@ class OnlineDecodable : public Decodable {
     feature_pipeline_->SetDone();
   }
 
+  // Bind the decodable to the workspace of the current thread
+  void SetWorkspace(NetWorkspace *workspace) {
+    workspace_ = workspace;
+  }
+
+  // The following functions split ComputeForFrame() into reading net input
+  // and accepting net output, so that the caller can forward the batches of
+  // many decodables at once, see BatchDecoder and DecodeTask.
+  // Returns the number of frames the batch beginning at frame covers,
+  // and the number of net input rows of it in num_frames_forward.
+  int32_t NumBatchFrames(int32_t frame, int32_t *num_frames_forward) const;
+  // in must be num_frames_forward x FeatureDim
+  void ReadBatchInput(int32_t frame, Matrix<float> *in);
+  void AcceptBatchOutput(int32_t frame, const Matrix<float>& out);
+
  private:
   void ComputeForFrame(int32_t frame);
 
@@ -122,11 +154,15 @@ class OnlineDecodable : public Decodable {
   const Tree& tree_;
   const Vector<float>& pdf_prior_;
   const DecodableOptions& options_;
-  Net *net_;
+  const Net *net_;
+  NetWorkspace *workspace_;
   FeaturePipeline *feature_pipeline_;
 
   int32_t begin_frame_;
   Matrix<float> scaled_loglikes_;
+  // FrameCosts() of costs_frame_
+  int32_t costs_frame_;
+  std::vector<float> costs_;
 };
 
 }  // namespace xdecoder
@@ -21,49 +21,180 @@
 
 namespace xdecoder {
 
+DecodeTask::DecodeTask(const FasterDecoderOptions& decoder_options,
+                       const DecodableOptions& decodable_options,
+                       const FeaturePipelineConfig& feature_options,
+                       const VadConfig& vad_options,
+                       const Fst& hclg,
+                       const Tree& tree,
+                       const Vector<float>& pdf_prior,
+                       const SymbolTable& words_table,
+                       const Matrix<float>& am_cmvn,
+                       const Matrix<float>& vad_cmvn,
+                       const Net& am_net,
+                       const Net& vad_net,
+                       ThreadPool* thread_pool,
+                       BatchNet* am_batch_net):
+    decoder_options_(decoder_options),
+    decodable_options_(decodable_options),
+    feature_options_(feature_options),
+    vad_options_(vad_options),
+    hclg_(hclg),
+    tree_(tree),
+    pdf_prior_(pdf_prior),
+    words_table_(words_table),
+    am_cmvn_(am_cmvn),
+    vad_cmvn_(vad_cmvn),
+    am_net_(am_net),
+    vad_net_(vad_net),
+    thread_pool_(thread_pool),
+    am_batch_net_(am_batch_net),
+    init_time_(0.0),
+    first_chunk_(true),
+    feature_pipeline_(feature_options_, am_cmvn_),
+    // Workspaces are bound to the worker thread in operator()
+    decodable_(tree_, pdf_prior_, decodable_options_, &am_net_, NULL,
+               &feature_pipeline_),
+    vad_(vad_options_, vad_cmvn_, &vad_net_, NULL),
+    decoder_(hclg_, decoder_options_),
+    end_of_stream_(false),
+    reset_(false),
+    net_frame_(-1),
+    scheduled_(false) {
+  CHECK(thread_pool_ != NULL);
+  if (pthread_mutex_init(&mutex_, NULL) != 0) {
+    ERROR("mutex init error");
+  }
+  if (pthread_cond_init(&idle_cond_, NULL) != 0) {
+    ERROR("cond init error");
+  }
+  decoder_.InitDecoding();
+  init_time_ = startup_timer_.Elapsed();
+}
+
+DecodeTask::~DecodeTask() {
+  pthread_mutex_lock(&mutex_);
+  while (scheduled_) {
+    pthread_cond_wait(&idle_cond_, &mutex_);
+  }
+  pthread_mutex_unlock(&mutex_);
+  pthread_mutex_destroy(&mutex_);
+  pthread_cond_destroy(&idle_cond_);
+}
+
+void DecodeTask::AddWavData(const std::vector<float>& data) {
+  bool schedule = false;
+  pthread_mutex_lock(&mutex_);
+  audio_queue_.push(data);
+  if (!scheduled_) {
+    scheduled_ = true;
+    schedule = true;
+  }
+  pthread_mutex_unlock(&mutex_);
+  if (schedule) thread_pool_->AddTask(this);
+}
+
 void DecodeTask::operator() (void *resource) {
-  Net* net = reinterpret_cast<Net*>(resource);
-  FeaturePipeline feature_pipeline(feature_options_);
-  OnlineDecodable decodable(tree_, pdf_prior_, decodable_options_,
-                            net, &feature_pipeline);
-  Vad vad(vad_options_);
-  FasterDecoder decoder(hclg_, decoder_options_);
-  decoder.InitDecoding();
-  bool done = false;
-  while (!done) {
-    std::vector<float> wav_data = audio_queue_.Get();
-    if (wav_data.size() == 0) {
-      // end of stream
-      done = true;
-    }
-    std::vector<float> speech_wav_data;
-    bool is_endpoint = vad.DoVad(wav_data, done, &speech_wav_data);
-    LOG("wav data %d speech data %d", static_cast<int>(wav_data.size()),
-                                      static_cast<int>(speech_wav_data.size()));
-    if (speech_wav_data.size() > 0) decodable.AcceptRawWav(speech_wav_data);
-    bool reset = false;
-    if (done || is_endpoint) {
-      decodable.SetDone();
-      reset = true;
-    }
-    decoder.AdvanceDecoding(&decodable);
-    std::vector<int32_t> result;
-    decoder.GetBestPath(&result);
-    std::ostringstream ss;
-    if (reset) {
-      ss << "final:";
-      decodable.Reset();
-      decoder.InitDecoding();
-    } else {
-      ss << "partial:";
-    }
-    for (size_t i = 0; i < result.size(); i++) {
-      ss << " " << words_table_.GetSymbol(result[i]);
-    }
-    result_queue_.Put(ss.str());
-    LOG("%s", ss.str().c_str());
+  DecodeResource* decode_resource = reinterpret_cast<DecodeResource*>(resource);
+  CHECK(decode_resource != NULL);
+  if (first_chunk_) {
+    first_chunk_ = false;
+    LOG("Session startup %lf ms, init %lf ms",
+        startup_timer_.Elapsed() * 1000, init_time_ * 1000);
+  }
+  if (net_frame_ < 0) {
+    // A new chunk
+    std::vector<float> wav_data;
+    pthread_mutex_lock(&mutex_);
+    CHECK(scheduled_ && !audio_queue_.empty());
+    wav_data.swap(audio_queue_.front());
+    audio_queue_.pop();
+    pthread_mutex_unlock(&mutex_);
+
+    vad_.SetWorkspace(&decode_resource->vad_workspace);
+    StartChunk(wav_data);
+    // Don't leave pointers to the workspace of this thread
+    vad_.SetWorkspace(NULL);
+  } else {
+    // Scheduled by the batch net, the likelihoods of the batch are ready
+    decodable_.AcceptBatchOutput(net_frame_, net_out_);
+    decoder_.AdvanceDecoding(&decodable_,
+                             decodable_.NumBatchFrames(net_frame_, NULL));
+    net_frame_ = -1;
+  }
+  if (!DecodeFrames(&decode_resource->am_workspace)) return;
+  FinishChunk();
+
+  // One chunk per schedule, go to the tail of the task queue if there are
+  // more chunks, so that a busy session can not starve the others
+  bool reschedule = false;
+  pthread_mutex_lock(&mutex_);
+  if (audio_queue_.empty()) {
+    scheduled_ = false;
+    pthread_cond_broadcast(&idle_cond_);
+  } else {
+    reschedule = true;
+  }
+  pthread_mutex_unlock(&mutex_);
+  if (reschedule) thread_pool_->AddTask(this);
+}
+
+void DecodeTask::StartChunk(const std::vector<float>& wav_data) {
+  // empty data means end of stream
+  end_of_stream_ = (wav_data.size() == 0);
+  std::vector<float> speech_wav_data;
+  bool is_endpoint = vad_.DoVad(wav_data, end_of_stream_, &speech_wav_data);
+  LOG("wav data %d speech data %d", static_cast<int>(wav_data.size()),
+                                    static_cast<int>(speech_wav_data.size()));
+  if (speech_wav_data.size() > 0) decodable_.AcceptRawWav(speech_wav_data);
+  reset_ = false;
+  if (end_of_stream_ || is_endpoint) {
+    decodable_.SetDone();
+    reset_ = true;
+  }
+}
+
+bool DecodeTask::DecodeFrames(NetWorkspace* am_workspace) {
+  if (am_batch_net_ == NULL) {
+    decodable_.SetWorkspace(am_workspace);
+    decoder_.AdvanceDecoding(&decodable_);
+    decodable_.SetWorkspace(NULL);
+    return true;
+  }
+  int32_t frame = decoder_.NumFramesDecoded();
+  if (frame >= decodable_.NumFramesReady()) return true;
+  // The next batch of frames goes to the batch net, which schedules the
+  // task again when its output is ready
+  int32_t num_frames_forward = 0;
+  decodable_.NumBatchFrames(frame, &num_frames_forward);
+  net_in_.Resize(num_frames_forward, am_batch_net_->InDim());
+  decodable_.ReadBatchInput(frame, &net_in_);
+  net_frame_ = frame;
+  am_batch_net_->Forward(net_in_, &net_out_, thread_pool_, this);
+  return false;
+}
+
+void DecodeTask::FinishChunk() {
+  std::vector<int32_t> result;
+  decoder_.GetBestPath(&result);
+  std::ostringstream ss;
+  if (reset_) {
+    ss << "final:";
+    decodable_.Reset();
+    decoder_.InitDecoding();
+  } else {
+    ss << "partial:";
+  }
+  for (size_t i = 0; i < result.size(); i++) {
+    ss << " " << words_table_.GetSymbol(result[i]);
+  }
+  result_queue_.Put(ss.str());
+  LOG("%s", ss.str().c_str());
+  if (end_of_stream_) {
+    // The session is ready for another stream
+    vad_.Reset();
+    LOG("Finish decoding");
   }
-  LOG("Finish decoding");
 }
 
 }  // namespace xdecoder
@@ -16,19 +16,40 @@
 #ifndef DECODE_TASK_H_
 #define DECODE_TASK_H_
 
+#include <pthread.h>
+
 #include <vector>
 #include <string>
+#include <queue>
 
+#include "batch-net.h"
 #include "decodable.h"
 #include "faster-decoder.h"
 #include "feature-pipeline.h"
 #include "net.h"
 #include "thread-pool.h"
 #include "message-queue.h"
+#include "timer.h"
 #include "vad.h"
 
 namespace xdecoder {
 
+// Per thread resource of the decoding thread pool. The am and vad nets are
+// shared by all the threads, every worker thread only holds the workspaces
+// to forward them
+struct DecodeResource {
+  NetWorkspace am_workspace;
+  NetWorkspace vad_workspace;
+};
+
+// DecodeTask is a resumable decoding session. It does not hold a worker
+// thread for the lifetime of the connection, instead every arriving audio
+// chunk schedules the task on the thread pool, and the worker processes one
+// chunk, saves the state in the task and returns. So the number of
+// concurrent sessions is not limited by the number of threads.
+// With the am batch net, the worker also returns while the task waits for
+// the likelihoods of a batch of frames, and the inference thread of the
+// batch net schedules the task again when they are ready.
 class DecodeTask : public Threadable {
  public:
   DecodeTask(const FasterDecoderOptions& decoder_options,
@@ -38,27 +59,36 @@ class DecodeTask : public Threadable {
              const Fst& hclg,
              const Tree& tree,
              const Vector<float>& pdf_prior,
-             const SymbolTable& words_table):
-      decoder_options_(decoder_options),
-      decodable_options_(decodable_options),
-      feature_options_(feature_options),
-      vad_options_(vad_options),
-      hclg_(hclg),
-      tree_(tree),
-      pdf_prior_(pdf_prior),
-      words_table_(words_table) {}
-
-  ~DecodeTask() {}
-  // Here resource is a pointer to a Nnet ojbect
+             const SymbolTable& words_table,
+             const Matrix<float>& am_cmvn,
+             const Matrix<float>& vad_cmvn,
+             const Net& am_net,
+             const Net& vad_net,
+             ThreadPool* thread_pool,
+             BatchNet* am_batch_net = NULL);
+
+  // Wait the running chunk(if any) to finish
+  ~DecodeTask();
+  // Process one audio chunk, or go on with it when the batch net output is
+  // ready, here resource is a pointer to a DecodeResource ojbect of current
+  // worker thread
   virtual void operator() (void* resource);
-  void AddWavData(const std::vector<float>& data) {
-    audio_queue_.Put(data);
-  }
+  // Queue the audio chunk, and schedule the task if it is idle,
+  // empty data means end of stream
+  void AddWavData(const std::vector<float>& data);
   std::string GetResult() {
     return result_queue_.Get();
   }
 
  private:
+  // Vad, then the speech goes to the decodable
+  void StartChunk(const std::vector<float>& wav_data);
+  // Decodes the frames ready, returns false if it is waiting for the batch
+  // net, then the task must not be touched until it is scheduled again
+  bool DecodeFrames(NetWorkspace* am_workspace);
+  // Puts the result, and resets the decoding at the endpoint
+  void FinishChunk();
+
   const FasterDecoderOptions& decoder_options_;
   const DecodableOptions& decodable_options_;
   const FeaturePipelineConfig& feature_options_;
@@ -67,9 +97,36 @@ class DecodeTask : public Threadable {
   const Tree& tree_;
   const Vector<float>& pdf_prior_;
   const SymbolTable& words_table_;
+  const Matrix<float>& am_cmvn_;
+  const Matrix<float>& vad_cmvn_;
+  const Net& am_net_;
+  const Net& vad_net_;
+  ThreadPool* thread_pool_;
+  BatchNet* am_batch_net_;
+  // Started when the task is created, for session startup latency
+  Timer startup_timer_;
+  double init_time_;
+  bool first_chunk_;
+
+  // Session state, kept between chunks
+  FeaturePipeline feature_pipeline_;
+  OnlineDecodable decodable_;
+  Vad vad_;
+  FasterDecoder decoder_;
+  // The chunk in progress ends the stream, or reaches an endpoint
+  bool end_of_stream_, reset_;
+  // The batch at net_frame_ is being forwarded by am_batch_net_, -1 if none
+  int32_t net_frame_;
+  Matrix<float> net_in_, net_out_;
 
-  MessageQueue<std::vector<float> > audio_queue_;
+  // Pending audio chunks, and whether the task is in the thread pool now,
+  // guarded by mutex_
+  std::queue<std::vector<float> > audio_queue_;
+  bool scheduled_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t idle_cond_;
   MessageQueue<std::string> result_queue_;
+  DISALLOW_COPY_AND_ASSIGN(DecodeTask);
 };
 
 }  // namespace xdecoder
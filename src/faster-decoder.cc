@@ -19,6 +19,9 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdio.h>
+#include <string.h>
+
 #include <algorithm>
 
 #include "faster-decoder.h"
@@ -28,26 +31,34 @@ namespace xdecoder {
 
 FasterDecoder::FasterDecoder(const Fst& fst,
                              const FasterDecoderOptions& opts):
-    fst_(fst), config_(opts), num_frames_decoded_(-1) {
+    fst_(&fst), compressed_fst_(NULL), config_(opts),
+    num_frames_decoded_(-1), num_active_toks_(0), trace_(NULL) {
+  CHECK(config_.hash_ratio >= 1.0);  // less doesn't make much sense.
+  CHECK(config_.max_active > 1);
+  CHECK(config_.min_active >= 0 && config_.min_active < config_.max_active);
+  // just so on the first frame we do something reasonable.
+  toks_.SetSize(1000);
+}
+
+FasterDecoder::FasterDecoder(const CompressedFst& fst,
+                             const FasterDecoderOptions& opts):
+    fst_(NULL), compressed_fst_(&fst), config_(opts),
+    num_frames_decoded_(-1), num_active_toks_(0), trace_(NULL) {
   CHECK(config_.hash_ratio >= 1.0);  // less doesn't make much sense.
   CHECK(config_.max_active > 1);
   CHECK(config_.min_active >= 0 && config_.min_active < config_.max_active);
   // just so on the first frame we do something reasonable.
   toks_.SetSize(1000);
-  // token_pool_ = new NaiveObjectPool<Token>(1024);
-  token_pool_ = new CacheObjectPool<Token>(1024);
 }
 
 void FasterDecoder::InitDecoding() {
   // clean up from last time:
-  ClearToks(toks_.Clear());
-  int32_t start_state = fst_.Start();
-  Arc dummy_arc(0, 0, 0.0f, start_state);
-  Token *token = token_pool_->New();
-  token->Init(dummy_arc, NULL);
-  toks_.Insert(start_state, token);
+  ClearToks();
+  int32_t start_state = Start();
+  toks_.Insert(start_state, NewToken(kNoArc, 0.0f, kNoToken));
   ProcessNonemitting(std::numeric_limits<float>::max());
   num_frames_decoded_ = 0;
+  num_active_toks_ = 0;
 }
 
 void FasterDecoder::Decode(Decodable* decodable) {
@@ -55,6 +66,7 @@ void FasterDecoder::Decode(Decodable* decodable) {
   while (!decodable->IsLastFrame(num_frames_decoded_ - 1)) {
     double weight_cutoff = ProcessEmitting(decodable);
     ProcessNonemitting(weight_cutoff);
+    if (trace_ != NULL) TraceFrame();
   }
 }
 
@@ -76,13 +88,77 @@ void FasterDecoder::AdvanceDecoding(Decodable *decodable,
     // note: ProcessEmitting() increments num_frames_decoded_
     double weight_cutoff = ProcessEmitting(decodable);
     ProcessNonemitting(weight_cutoff);
+    if (trace_ != NULL) TraceFrame();
+  }
+}
+
+void FasterDecoder::SetTrace(DecodeTrace *trace) {
+  trace_ = trace;
+  if (trace_ == NULL) return;
+  int32_t num_states = fst_ != NULL ? fst_->NumStates() :
+                                      compressed_fst_->NumStates();
+  int32_t num_arcs = fst_ != NULL ? fst_->NumArcs() :
+                                    compressed_fst_->NumArcs();
+  if (static_cast<int32_t>(trace_->state_counts.size()) < num_states)
+    trace_->state_counts.resize(num_states, 0);
+  if (static_cast<int32_t>(trace_->arc_counts.size()) < num_arcs)
+    trace_->arc_counts.resize(num_arcs, 0);
+}
+
+void FasterDecoder::TraceFrame() {
+  const std::vector<Elem> &toks = toks_.GetList();
+  for (const Elem *e = toks.data(); e != toks.data() + toks.size(); e++) {
+    trace_->state_counts[e->key]++;
+    int32_t arc_index = token_pool_.Get(e->val)->arc_index_;
+    if (arc_index != kNoArc) trace_->arc_counts[arc_index]++;
+  }
+}
+
+void DecodeTrace::Read(const std::string& file) {
+  FILE *fp = fopen(file.c_str(), "r");
+  if (!fp) {
+    ERROR("file %s not exist", file.c_str());
+  }
+  char buffer[1024], type[1024];
+  int32_t id;
+  int64_t count;
+  while (fgets(buffer, 1024, fp)) {
+    if (sscanf(buffer, "%s %d %ld", type, &id, &count) != 3 || id < 0) {
+      ERROR("wrong line in trace %s: %s", file.c_str(), buffer);
+    }
+    std::vector<int64_t> *counts = NULL;
+    if (strcmp(type, "state") == 0) {
+      counts = &state_counts;
+    } else if (strcmp(type, "arc") == 0) {
+      counts = &arc_counts;
+    } else {
+      ERROR("wrong line in trace %s: %s", file.c_str(), buffer);
+    }
+    if (id >= static_cast<int32_t>(counts->size())) counts->resize(id + 1, 0);
+    (*counts)[id] += count;
   }
+  fclose(fp);
+}
+
+void DecodeTrace::Write(const std::string& file) const {
+  FILE *fp = fopen(file.c_str(), "w");
+  if (!fp) {
+    ERROR("write file %s error, check!!!", file.c_str());
+  }
+  for (size_t i = 0; i < state_counts.size(); i++) {
+    if (state_counts[i] > 0) fprintf(fp, "state %zu %ld\n", i, state_counts[i]);
+  }
+  for (size_t i = 0; i < arc_counts.size(); i++) {
+    if (arc_counts[i] > 0) fprintf(fp, "arc %zu %ld\n", i, arc_counts[i]);
+  }
+  fclose(fp);
 }
 
 bool FasterDecoder::ReachedFinal() {
-  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
-    if (e->val->cost_ != std::numeric_limits<double>::infinity() &&
-        fst_.IsFinal(e->key))
+  const std::vector<Elem> &toks = toks_.GetList();
+  for (const Elem *e = toks.data(); e != toks.data() + toks.size(); e++) {
+    if (TokenCost(e->val) != std::numeric_limits<float>::infinity() &&
+        IsFinal(e->key))
       return true;
   }
   return false;
@@ -96,29 +172,33 @@ bool FasterDecoder::GetBestPath(std::vector<int32_t> *results,
   // account final-probs.  results will be empty if
   // nothing was available.  It returns true if it got output.
   results->clear();
-  Token *best_tok = NULL;
+  uint32_t best_tok = kNoToken;
   bool is_final = ReachedFinal();
+  const std::vector<Elem> &toks = toks_.GetList();
   if (!is_final) {
-    for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
-      if (best_tok == NULL || *best_tok < *(e->val) )
+    for (const Elem *e = toks.data(); e != toks.data() + toks.size(); e++)
+      if (best_tok == kNoToken || TokenCost(best_tok) > TokenCost(e->val))
         best_tok = e->val;
   } else {
     double infinity =  std::numeric_limits<double>::infinity(),
         best_cost = infinity;
-    for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
-      double this_cost = e->val->cost_ + fst_.Final(e->key);
+    for (const Elem *e = toks.data(); e != toks.data() + toks.size(); e++) {
+      double this_cost = TokenCost(e->val) + Final(e->key);
       if (this_cost < best_cost && this_cost != infinity) {
         best_cost = this_cost;
         best_tok = e->val;
       }
     }
   }
-  if (best_tok == NULL) return false;  // No output.
+  if (best_tok == kNoToken) return false;  // No output.
 
   std::vector<int32_t> results_reverse;
-  for (Token *tok = best_tok; tok != NULL; tok = tok->prev_) {
-    if (tok->arc_.olabel > 0)
-      results_reverse.push_back(tok->arc_.olabel);
+  for (uint32_t tok = best_tok; tok != kNoToken;
+       tok = token_pool_.Get(tok)->prev_) {
+    int32_t arc_index = token_pool_.Get(tok)->arc_index_;
+    int32_t olabel = arc_index != kNoArc ? OLabel(arc_index) : 0;
+    if (olabel > 0)
+      results_reverse.push_back(olabel);
   }
   // results_reverse.pop_back();  // that was a "fake" token... gives no info.
 
@@ -130,14 +210,16 @@ bool FasterDecoder::GetBestPath(std::vector<int32_t> *results,
 }
 
 // Gets the weight cutoff.  Also counts the active tokens.
-double FasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
-                                float *adaptive_beam, Elem **best_elem) {
+double FasterDecoder::GetCutoff(const std::vector<Elem> &toks,
+                                size_t *tok_count, float *adaptive_beam,
+                                const Elem **best_elem) {
   double best_cost = std::numeric_limits<double>::infinity();
   size_t count = 0;
   if (config_.max_active == std::numeric_limits<int32_t>::max() &&
       config_.min_active == 0) {
-    for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
-      double w = e->val->cost_;
+    for (const Elem *e = toks.data(); e != toks.data() + toks.size();
+         e++, count++) {
+      double w = TokenCost(e->val);
       if (w < best_cost) {
         best_cost = w;
         if (best_elem) *best_elem = e;
@@ -147,9 +229,16 @@ double FasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
     if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
     return best_cost + config_.beam;
   } else {
+    double cutoff;
+    if (config_.cutoff_bins > 0 &&
+        GetHistogramCutoff(toks, tok_count, adaptive_beam, best_elem,
+                           &cutoff)) {
+      return cutoff;
+    }
     tmp_array_.clear();
-    for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
-      double w = e->val->cost_;
+    for (const Elem *e = toks.data(); e != toks.data() + toks.size();
+         e++, count++) {
+      double w = TokenCost(e->val);
       tmp_array_.push_back(w);
       if (w < best_cost) {
         best_cost = w;
@@ -195,24 +284,120 @@ double FasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
   }
 }
 
+// The bins cover [anchor - beam, anchor + beam), anchor is the cost of the
+// first token, so the best cost is known only after the pass. It fails if
+// some token is below the range, or if the range has too few tokens for
+// min_active. Tokens above the range are beyond best_cost + beam, so they
+// don't matter for max_active.
+bool FasterDecoder::GetHistogramCutoff(const std::vector<Elem> &toks,
+                                       size_t *tok_count,
+                                       float *adaptive_beam,
+                                       const Elem **best_elem,
+                                       double *cutoff) {
+  if (toks.empty()) return false;
+  int32_t num_bins = 2 * config_.cutoff_bins;
+  float bin_width = config_.beam / config_.cutoff_bins;
+  float lower = TokenCost(toks[0].val) - config_.beam;
+  float best_cost = std::numeric_limits<float>::infinity();
+  const Elem *best = NULL;
+  histogram_.assign(num_bins, 0);
+  for (const Elem *e = toks.data(); e != toks.data() + toks.size(); e++) {
+    float w = TokenCost(e->val);
+    if (w < best_cost) {
+      best_cost = w;
+      best = e;
+    }
+    float bin = (w - lower) / bin_width;
+    if (bin < 0) return false;
+    if (bin < num_bins) histogram_[static_cast<int32_t>(bin)]++;
+  }
+  if (best_elem) *best_elem = best;
+  if (tok_count != NULL) *tok_count = toks.size();
+
+  double beam_cutoff = best_cost + config_.beam,
+      min_active_cutoff = std::numeric_limits<double>::infinity(),
+      max_active_cutoff = std::numeric_limits<double>::infinity();
+  // max_active: the lower edge of the bin where max_active is exceeded,
+  // which keeps no more than max_active tokens, unless that bin holds the
+  // best token
+  size_t num_toks = 0;
+  for (int32_t i = 0; i < num_bins; i++) {
+    num_toks += histogram_[i];
+    if (num_toks > static_cast<size_t>(config_.max_active)) {
+      max_active_cutoff = lower + i * bin_width;
+      if (max_active_cutoff <= best_cost)
+        max_active_cutoff = lower + (i + 1) * bin_width;
+      break;
+    }
+  }
+  if (max_active_cutoff < beam_cutoff) {  // max_active is tighter than beam.
+    if (adaptive_beam)
+      *adaptive_beam = max_active_cutoff - best_cost + config_.beam_delta;
+    *cutoff = max_active_cutoff;
+    return true;
+  }
+  // min_active: the upper edge of the bin where min_active is exceeded,
+  // which keeps at least min_active tokens
+  if (toks.size() > static_cast<size_t>(config_.min_active)) {
+    if (config_.min_active == 0) {
+      min_active_cutoff = best_cost;
+    } else {
+      num_toks = 0;
+      int32_t i = 0;
+      for (; i < num_bins; i++) {
+        num_toks += histogram_[i];
+        if (num_toks > static_cast<size_t>(config_.min_active)) break;
+      }
+      if (i == num_bins) return false;
+      min_active_cutoff = lower + (i + 1) * bin_width;
+    }
+  }
+  if (min_active_cutoff > beam_cutoff) {  // min_active is looser than beam.
+    if (adaptive_beam)
+      *adaptive_beam = min_active_cutoff - best_cost + config_.beam_delta;
+    *cutoff = min_active_cutoff;
+  } else {
+    if (adaptive_beam) *adaptive_beam = config_.beam;
+    *cutoff = beam_cutoff;
+  }
+  return true;
+}
+
 void FasterDecoder::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<float>(num_toks)
                                       * config_.hash_ratio);
-  if (new_sz > toks_.Size()) {
-    toks_.SetSize(new_sz);
+  // TokenMap may shrink as well as grow here
+  toks_.SetSize(new_sz);
+}
+
+double FasterDecoder::ProcessEmitting(Decodable* decodable) {
+  if (fst_ != NULL) {
+    return ProcessEmitting(*fst_, decodable);
+  } else {
+    return ProcessEmitting(*compressed_fst_, decodable);
+  }
+}
+
+void FasterDecoder::ProcessNonemitting(double cutoff) {
+  if (fst_ != NULL) {
+    ProcessNonemitting(*fst_, cutoff);
+  } else {
+    ProcessNonemitting(*compressed_fst_, cutoff);
   }
 }
 
 // ProcessEmitting returns the likelihood cutoff used.
-double FasterDecoder::ProcessEmitting(Decodable* decodable) {
+template <class FST>
+double FasterDecoder::ProcessEmitting(const FST &fst, Decodable* decodable) {
   int32_t frame = num_frames_decoded_;
-  Elem *last_toks = toks_.Clear();
+  toks_.Clear(&last_toks_);
   size_t tok_cnt;
   float adaptive_beam;
-  Elem *best_elem = NULL;
-  double weight_cutoff = GetCutoff(last_toks, &tok_cnt,
+  const Elem *best_elem = NULL;
+  double weight_cutoff = GetCutoff(last_toks_, &tok_cnt,
                                    &adaptive_beam, &best_elem);
   // KALDI_VLOG(3) << tok_cnt << " tokens active.";
+  num_active_toks_ += tok_cnt;
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough
 
   // This is the cutoff we use after adding in the log-likes (i.e.
@@ -220,119 +405,111 @@ double FasterDecoder::ProcessEmitting(Decodable* decodable) {
   // on the next frame.
   double next_weight_cutoff = std::numeric_limits<double>::infinity();
 
+  // Acoustic costs of this frame indexed by ilabel, one virtual call only,
+  // the ilabels are checked against the tree when the graph is loaded
+  const float *ac_costs = decodable->FrameCosts(frame);
+
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.
   if (best_elem) {
     int32_t state = best_elem->key;
-    Token *tok = best_elem->val;
-    for (const Arc* it = fst_.ArcStart(state); it != fst_.ArcEnd(state); it++) {
-      const Arc &arc = *it;
-      if (arc.ilabel != 0) {  // we'd propagate..
-        float ac_cost = - decodable->LogLikelihood(frame, arc.ilabel);
-        double new_weight = arc.weight + tok->cost_ + ac_cost;
-        if (new_weight + adaptive_beam < next_weight_cutoff)
-          next_weight_cutoff = new_weight + adaptive_beam;
-      }
+    float tok_cost = TokenCost(best_elem->val);
+    for (typename FST::ArcIterator aiter(fst, state, false); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      float ac_cost = ac_costs[arc.ilabel];
+      float new_weight = tok_cost + arc.weight + ac_cost;
+      if (new_weight + adaptive_beam < next_weight_cutoff)
+        next_weight_cutoff = new_weight + adaptive_beam;
     }
   }
 
   // int32_t n = 0, np = 0;
 
-  // the tokens are now owned here, in last_toks, and the hash is empty.
-  // 'owned' is a complex thing here; the point is we need to call TokenDelete
-  // on each elem 'e' to let toks_ know we're done with them.
-  for (Elem *e = last_toks, *e_tail; e != NULL; e = e_tail) {  // loop this way
+  // the tokens are now owned here, in last_toks_, and the map is empty.
+  // we need to call TokenDelete on each elem 'e' when we're done with it.
+  for (const Elem *e = last_toks_.data();
+       e != last_toks_.data() + last_toks_.size(); e++) {
     // n++;
-    // because we delete "e" as we go.
     int32_t state = e->key;
-    Token *tok = e->val;
-    if (tok->cost_ < weight_cutoff) {  // not pruned.
+    uint32_t tok = e->val;
+    float tok_cost = TokenCost(tok);
+    if (tok_cost < weight_cutoff) {  // not pruned.
       // np++;
-      CHECK(state == tok->arc_.next_state);
-      for (const Arc* it = fst_.ArcStart(state);
-           it != fst_.ArcEnd(state); it++) {
-        const Arc &arc = *it;
-        if (arc.ilabel != 0) {  // propagate..
-          float ac_cost =  - decodable->LogLikelihood(frame, arc.ilabel);
-          double new_weight = arc.weight + tok->cost_ + ac_cost;
-          if (new_weight < next_weight_cutoff) {  // not pruned..
-            Token *new_tok = token_pool_->New();
-            new_tok->Init(arc, ac_cost, tok);
-            Elem *e_found = toks_.Find(arc.next_state);
-            if (new_weight + adaptive_beam < next_weight_cutoff)
-              next_weight_cutoff = new_weight + adaptive_beam;
-            if (e_found == NULL) {
-              toks_.Insert(arc.next_state, new_tok);
-            } else {
-              if ( *(e_found->val) < *new_tok ) {
-                Token::TokenDelete(e_found->val, token_pool_);
-                e_found->val = new_tok;
-              } else {
-                Token::TokenDelete(new_tok, token_pool_);
-              }
-            }
+      for (typename FST::ArcIterator aiter(fst, state, false); !aiter.Done();
+           aiter.Next()) {
+        const Arc &arc = aiter.Value();
+        float ac_cost = ac_costs[arc.ilabel];
+        float new_weight = tok_cost + arc.weight + ac_cost;
+        if (new_weight < next_weight_cutoff) {  // not pruned..
+          Elem *e_found = toks_.Find(arc.next_state);
+          if (new_weight + adaptive_beam < next_weight_cutoff)
+            next_weight_cutoff = new_weight + adaptive_beam;
+          // Only allocate a token when it survives
+          if (e_found == NULL) {
+            toks_.Insert(arc.next_state,
+                         NewToken(aiter.Index(), new_weight, tok));
+          } else if (TokenCost(e_found->val) > new_weight) {
+            uint32_t new_tok = NewToken(aiter.Index(), new_weight, tok);
+            TokenDelete(e_found->val);
+            e_found->val = new_tok;
           }
         }
       }
     }
-    e_tail = e->tail;
-    Token::TokenDelete(e->val, token_pool_);
-    toks_.Delete(e);
+    TokenDelete(e->val);
   }
+  last_toks_.clear();
   num_frames_decoded_++;
   return next_weight_cutoff;
 }
 
 // TODO(Binbin): first time we go through this, could avoid using the queue.
-void FasterDecoder::ProcessNonemitting(double cutoff) {
+template <class FST>
+void FasterDecoder::ProcessNonemitting(const FST &fst, double cutoff) {
   // Processes nonemitting arcs for one frame.
   CHECK(queue_.empty());
-  for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
-    queue_.push_back(e->key);
+  const std::vector<Elem> &toks = toks_.GetList();
+  for (size_t i = 0; i < toks.size(); i++)
+    queue_.push_back(toks[i].key);
   while (!queue_.empty()) {
     int32_t state = queue_.back();
     queue_.pop_back();
-    Token *tok = toks_.Find(state)->val;  // would segfault if state not
+    uint32_t tok = toks_.Find(state)->val;  // would segfault if state not
     // in toks_ but this can't happen.
-    if (tok->cost_ > cutoff) {  // Don't bother processing successors.
+    float tok_cost = TokenCost(tok);
+    if (tok_cost > cutoff) {  // Don't bother processing successors.
       continue;
     }
-    CHECK(tok != NULL && state == tok->arc_.next_state);
-    for (const Arc *it = fst_.ArcStart(state);
-        it != fst_.ArcEnd(state); it++) {
-      const Arc &arc = *it;
-      if (arc.ilabel == 0) {  // propagate nonemitting only...
-        Token *new_tok = token_pool_->New();
-        new_tok->Init(arc, tok);
-
-        if (new_tok->cost_ > cutoff) {  // prune
-          Token::TokenDelete(new_tok, token_pool_);
-        } else {
-          Elem *e_found = toks_.Find(arc.next_state);
-          if (e_found == NULL) {
-            toks_.Insert(arc.next_state, new_tok);
-            queue_.push_back(arc.next_state);
-          } else {
-            if ( *(e_found->val) < *new_tok ) {
-              Token::TokenDelete(e_found->val, token_pool_);
-              e_found->val = new_tok;
-              queue_.push_back(arc.next_state);
-            } else {
-              Token::TokenDelete(new_tok, token_pool_);
-            }
-          }
+    // nonemitting only
+    for (typename FST::ArcIterator aiter(fst, state, true); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      float new_cost = tok_cost + arc.weight;
+      if (new_cost <= cutoff) {  // not pruned
+        Elem *e_found = toks_.Find(arc.next_state);
+        if (e_found == NULL) {
+          toks_.Insert(arc.next_state,
+                       NewToken(aiter.Index(), new_cost, tok));
+          queue_.push_back(arc.next_state);
+        } else if (TokenCost(e_found->val) > new_cost) {
+          // New token first, the old one may be tok itself
+          uint32_t new_tok = NewToken(aiter.Index(), new_cost, tok);
+          TokenDelete(e_found->val);
+          e_found->val = new_tok;
+          queue_.push_back(arc.next_state);
         }
       }
     }
   }
 }
 
-void FasterDecoder::ClearToks(Elem *list) {
-  for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
-    Token::TokenDelete(e->val, token_pool_);
-    e_tail = e->tail;
-    toks_.Delete(e);
+void FasterDecoder::ClearToks() {
+  const std::vector<Elem> &toks = toks_.GetList();
+  for (size_t i = 0; i < toks.size(); i++) {
+    TokenDelete(toks[i].val);
   }
+  toks_.Clear();
 }
 
 }  // namespace xdecoder
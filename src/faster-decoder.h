@@ -29,8 +29,9 @@
 
 #include "utils.h"
 #include "tree.h"
-#include "hash-list.h"
+#include "token-map.h"
 #include "fst.h"
+#include "compressed-fst.h"
 #include "decodable.h"
 #include "object-pool.h"
 
@@ -42,24 +43,41 @@ struct FasterDecoderOptions {
   int32_t min_active;
   float beam_delta;
   float hash_ratio;
+  // If > 0, the max_active/min_active cutoffs are estimated by a histogram
+  // with this many bins per beam instead of exact nth_element, the cutoff
+  // error is at most beam / cutoff_bins. Larger->more accurate, slower.
+  int32_t cutoff_bins;
   FasterDecoderOptions(): beam(16.0),
                           max_active(std::numeric_limits<int32_t>::max()),
                           min_active(20),   // This decoder mostly used for
                                             // alignment, use small default.
                           beam_delta(0.5),
-                          hash_ratio(2.0) { }
+                          hash_ratio(2.0),
+                          cutoff_bins(0) { }
+};
+
+// How many frames each state was active and each arc led to an active
+// token, summed over the decoded frames, to find the hot spots of the graph.
+// The text format has a line of "state id count" or "arc index count" for
+// every nonzero count, see fst-info.
+struct DecodeTrace {
+  std::vector<int64_t> state_counts;
+  std::vector<int64_t> arc_counts;
+  void Read(const std::string& file);
+  void Write(const std::string& file) const;
 };
 
 class FasterDecoder {
  public:
   FasterDecoder(const Fst& fst,
                 const FasterDecoderOptions& config);
+  FasterDecoder(const CompressedFst& fst,
+                const FasterDecoderOptions& config);
 
   void SetOptions(const FasterDecoderOptions &config) { config_ = config; }
 
   ~FasterDecoder() {
-    ClearToks(toks_.Clear());
-    delete token_pool_;
+    ClearToks();
   }
 
   void Decode(Decodable *decodable);
@@ -88,67 +106,73 @@ class FasterDecoder {
   /// Returns the number of frames already decoded.
   int32_t NumFramesDecoded() const { return num_frames_decoded_; }
 
+  /// Returns the sum of the active tokens of the frames decoded, which
+  /// tells how hard the search is, eg. to compare graphs.
+  int64_t NumActiveTokens() const { return num_active_toks_; }
+
+  std::string TokenPoolReport() { return token_pool_.Report(); }
+
+  /// Counts the active tokens of every decoded frame into trace, NULL to
+  /// stop. It keeps counting over the following utterances.
+  void SetTrace(DecodeTrace *trace);
+
  protected:
-  class Token {
-   public:
-    Arc arc_;  // contains only the graph part of the cost;
-    // we can work out the acoustic part from difference between
-    // "cost_" and prev->cost_.
-    Token *prev_;
+  // Compact token, 16 bytes. The arc is referred to by its index in the
+  // fst instead of a copy, and prev_ is an index in token_pool_ instead of
+  // a pointer; cost_ is a float, which is precise enough for the beam.
+  struct Token {
+    // index of the arc this token came through, the graph part of the cost
+    // is in it; we can work out the acoustic part from the difference
+    // between "cost_" and the prev cost_.
+    int32_t arc_index_;
+    uint32_t prev_;
     int32_t ref_count_;
-    // if you are looking for weight_ here, it was removed and now we just have
-    // cost_, which corresponds to ConvertToCost(weight_).
-    double cost_;
-    inline Token(): prev_(NULL), ref_count_(1) {}
-    inline void Init(const Arc &arc, float ac_cost, Token *prev) {
-      arc_ = arc;
-      prev_ = prev;
-      ref_count_ = 1;
-      if (prev) {
-        prev->ref_count_++;
-        cost_ = prev->cost_ + arc.weight + ac_cost;
-      } else {
-        cost_ = arc.weight + ac_cost;
-      }
-    }
-    inline Token(const Arc &arc, float ac_cost, Token *prev) {
-      Init(arc, ac_cost, prev);
-    }
-    inline void Init(const Arc &arc, Token *prev) {
-      arc_ = arc;
-      prev_ = prev;
-      ref_count_ = 1;
-      if (prev) {
-        prev->ref_count_++;
-        cost_ = prev->cost_ + arc.weight;
-      } else {
-        cost_ = arc.weight;
-      }
-    }
-    inline Token(const Arc &arc, Token *prev) {
-      Init(arc, prev);
-    }
-    inline bool operator < (const Token &other) {
-      return cost_ > other.cost_;
-    }
+    float cost_;
+  };
+  typedef IndexedObjectPool<Token> TokenPool;
+  static const int32_t kNoArc = -1;  // arc of the start token
+  static const uint32_t kNoToken = TokenPool::kNullIndex;
+
+  inline uint32_t NewToken(int32_t arc_index, float cost, uint32_t prev) {
+    uint32_t tok = token_pool_.New();
+    Token *token = token_pool_.Get(tok);
+    token->arc_index_ = arc_index;
+    token->prev_ = prev;
+    token->ref_count_ = 1;
+    token->cost_ = cost;
+    if (prev != kNoToken) token_pool_.Get(prev)->ref_count_++;
+    return tok;
+  }
 
-    inline static void TokenDelete(Token *tok, IObjectPool<Token> *token_pool) {
-      while (--tok->ref_count_ == 0) {
-        Token *prev = tok->prev_;
-        token_pool->Delete(tok);
-        if (prev == NULL) return;
-        else
-          tok = prev;
-      }
-      CHECK(tok->ref_count_ > 0);
+  inline void TokenDelete(uint32_t tok) {
+    Token *token = token_pool_.Get(tok);
+    while (--token->ref_count_ == 0) {
+      uint32_t prev = token->prev_;
+      token_pool_.Delete(tok);
+      if (prev == kNoToken) return;
+      tok = prev;
+      token = token_pool_.Get(tok);
     }
-  };
-  typedef HashList<int32_t, Token*>::Elem Elem;
+    CHECK(token->ref_count_ > 0);
+  }
+
+  inline float TokenCost(uint32_t tok) const {
+    return token_pool_.Get(tok)->cost_;
+  }
+
+  typedef TokenMap<int32_t, uint32_t>::Elem Elem;
 
 
   /// Gets the weight cutoff.  Also counts the active tokens.
-  double GetCutoff(Elem *list_head, size_t *tok_count,
-                   float *adaptive_beam, Elem **best_elem);
+  double GetCutoff(const std::vector<Elem> &toks, size_t *tok_count,
+                   float *adaptive_beam, const Elem **best_elem);
+
+  /// Histogram version of GetCutoff, which needs only one pass over the
+  /// tokens and no sort. Returns false if the histogram can't tell the
+  /// cutoff, then GetCutoff() should be used.
+  bool GetHistogramCutoff(const std::vector<Elem> &toks, size_t *tok_count,
+                          float *adaptive_beam, const Elem **best_elem,
+                          double *cutoff);
 
   void PossiblyResizeHash(size_t num_toks);
 
@@ -161,30 +185,54 @@ class FasterDecoder {
   // could avoid using the queue.
   void ProcessNonemitting(double cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
-  // more than one list (e.g. for current and previous frames), but only one of
-  // them at a time can be indexed by int32_t.
-  HashList<int32_t, Token*> toks_;
-  const Fst& fst_;
+  // Adds the tokens of the frame just decoded to trace_
+  void TraceFrame();
+
+  // The search over either kind of graph, FST is Fst or CompressedFst.
+  // The functions above choose one of them once per frame.
+  template <class FST>
+  double ProcessEmitting(const FST &fst, Decodable *decodable);
+  template <class FST>
+  void ProcessNonemitting(const FST &fst, double cutoff);
+
+  int32_t Start() const {
+    return fst_ != NULL ? fst_->Start() : compressed_fst_->Start();
+  }
+  bool IsFinal(int32_t state) const {
+    return fst_ != NULL ? fst_->IsFinal(state) :
+                          compressed_fst_->IsFinal(state);
+  }
+  float Final(int32_t state) const {
+    return fst_ != NULL ? fst_->Final(state) : compressed_fst_->Final(state);
+  }
+  int32_t OLabel(int32_t arc_index) const {
+    return fst_ != NULL ? fst_->OLabel(arc_index) :
+                          compressed_fst_->OLabel(arc_index);
+  }
+
+  // Tokens of the current frame, indexed by state, see token-map.h
+  TokenMap<int32_t, uint32_t> toks_;
+  // Tokens of the last frame, a class member to reuse its memory
+  std::vector<Elem> last_toks_;
+  // Exactly one of them is set
+  const Fst *fst_;
+  const CompressedFst *compressed_fst_;
   FasterDecoderOptions config_;
   std::vector<int32_t> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<float> tmp_array_;  // used in GetCutoff.
+  std::vector<int32_t> histogram_;  // used in GetHistogramCutoff.
   // make it class member to avoid internal new/delete.
 
   // Keep track of the number of frames decoded in the current file.
   int32_t num_frames_decoded_;
+  int64_t num_active_toks_;
+  DecodeTrace *trace_;
 
   // Token pool
-  IObjectPool<Token> *token_pool_;
-
-  // It might seem unclear why we call ClearToks(toks_.Clear()).
-  // There are two separate cleanup tasks we need to do at when we start a
-  // new file. one is to delete the Token objects in the list; the other is
-  // to delete the Elem objects.  toks_.Clear() just clears them from the hash
-  // and gives ownership to the caller, who then has to call toks_.Delete(e)
-  // for each one.  It was designed this way for convenience in propagating
-  // tokens from one frame to the next.
-  void ClearToks(Elem *list);
+  TokenPool token_pool_;
+
+  // Deletes all the tokens in toks_, and clears it
+  void ClearToks();
 
  private:
   DISALLOW_COPY_AND_ASSIGN(FasterDecoder);
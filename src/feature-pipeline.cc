@@ -24,6 +24,7 @@ FeaturePipeline::FeaturePipeline(const FeaturePipelineConfig& config):
     left_context_(config.left_context),
     right_context_(config.right_context),
     raw_feat_dim_(config.num_bins),
+    cmvn_(&own_cmvn_),
     fbank_(config.num_bins, config.sample_rate,
            config.frame_length, config.frame_shift),
     num_frames_(0),
@@ -31,9 +32,23 @@ FeaturePipeline::FeaturePipeline(const FeaturePipelineConfig& config):
   ReadCmvn(config.cmvn_file);
 }
 
+FeaturePipeline::FeaturePipeline(const FeaturePipelineConfig& config,
+                                 const Matrix<float>& cmvn):
+    config_(config),
+    left_context_(config.left_context),
+    right_context_(config.right_context),
+    raw_feat_dim_(config.num_bins),
+    cmvn_(&cmvn),
+    fbank_(config.num_bins, config.sample_rate,
+           config.frame_length, config.frame_shift),
+    num_frames_(0),
+    done_(false) {
+  CHECK(cmvn_->NumCols() == raw_feat_dim_);
+}
+
 void FeaturePipeline::ReadCmvn(const std::string& cmvn_file) {
-  cmvn_.Read(cmvn_file);
-  CHECK(cmvn_.NumCols() == raw_feat_dim_);
+  own_cmvn_.Read(cmvn_file);
+  CHECK(own_cmvn_.NumCols() == raw_feat_dim_);
 }
 
 void FeaturePipeline::AcceptRawWav(const std::vector<float>& wav) {
@@ -43,12 +58,13 @@ void FeaturePipeline::AcceptRawWav(const std::vector<float>& wav) {
   waves.insert(waves.end(), wav.begin(), wav.end());
   int num_frames = fbank_.Compute(waves, &feat);
   // do cmvn
-  CHECK(raw_feat_dim_ == cmvn_.NumCols());
+  const Matrix<float>& cmvn = *cmvn_;
+  CHECK(raw_feat_dim_ == cmvn.NumCols());
   for (int i = 0; i < num_frames; i++) {
     for (int j = 0; j < raw_feat_dim_; j++) {
       CHECK(i * raw_feat_dim_ + j < static_cast<int>(feat.size()));
       feat[i*raw_feat_dim_+j] =
-          (feat[i*raw_feat_dim_+j] - cmvn_(0, j)) * cmvn_(1, j);
+          (feat[i*raw_feat_dim_+j] - cmvn(0, j)) * cmvn(1, j);
       // printf("%f ", feat[i*raw_feat_dim+j]);
     }
     // printf("\n");
@@ -53,6 +53,10 @@ struct FeaturePipelineConfig {
 class FeaturePipeline {
  public:
   explicit FeaturePipeline(const FeaturePipelineConfig& config);
+  // Use a cmvn which is already loaded and shared by many pipelines,
+  // config.cmvn_file is ignored in this case
+  FeaturePipeline(const FeaturePipelineConfig& config,
+                  const Matrix<float>& cmvn);
 
   void AcceptRawWav(const std::vector<float>& wav);
   int NumFramesReady() const;
@@ -85,7 +89,8 @@ class FeaturePipeline {
   // mean: first row, inv_var: second row
   int left_context_, right_context_;
   int raw_feat_dim_;
-  Matrix<float> cmvn_;
+  Matrix<float> own_cmvn_;
+  const Matrix<float>* cmvn_;
   Fbank fbank_;
   std::vector<float> feature_buf_;
   int num_frames_;
@@ -14,8 +14,12 @@
 // limitations under the License.
 
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 
 #include "fst.h"
 #include "varint.h"
@@ -38,121 +42,352 @@ void Arc::Write(std::ostream& os) const {
 
 void Fst::Reset() {
   start_ = 0;
-  arcs_.clear();
-  arc_offset_.clear();
-  finals_.clear();
+  num_states_ = num_arcs_ = num_finals_ = 0;
+  arc_offset_ = num_eps_arcs_ = NULL;
+  finals_ = NULL;
+  arcs_ = NULL;
+  own_arc_offset_.clear();
+  own_num_eps_arcs_.clear();
+  own_finals_.clear();
+  own_arcs_.clear();
+  mapped_file_.Unmap();
 }
 
-// A stupid implementation, it will be very slow when the
-// isymbol_tabel or osymbol_table is very big, for that
-// SymbolTable is designed for find symbol by id, but aslo
-// have a stupid implementaion of find id by symbol.
-// However,for memory reasons, it's not in an efficient way
-void Fst::ReadTopo(const std::string& topo_file,
-                   const SymbolTable& isymbol_table,
-                   const SymbolTable& osymbol_table) {
-  Reset();
-  FILE *fp = fopen(topo_file.c_str(), "r");
-  if (!fp) {
-    ERROR("file %s not exist", topo_file.c_str());
+static bool IsEpsArc(const Arc& arc) {
+  return arc.ilabel == 0;
+}
+
+void Fst::Init(std::vector<std::vector<Arc> > *all_arcs,
+               const std::map<int32_t, float> &finals) {
+  // all_arcs is a copy, so the old views can go
+  own_arcs_.clear();
+  mapped_file_.Unmap();
+  // the last final state may have no arc at all
+  if (!finals.empty() &&
+      finals.rbegin()->first >= static_cast<int32_t>(all_arcs->size())) {
+    all_arcs->resize(finals.rbegin()->first + 1);
+  }
+  own_arc_offset_.resize(all_arcs->size());
+  own_num_eps_arcs_.resize(all_arcs->size());
+  int32_t offset = 0;
+  for (uint32_t i = 0; i < all_arcs->size(); i++) {
+    std::vector<Arc>& arcs = (*all_arcs)[i];
+    // epsilon arcs first, see EpsArcs() and EmittingArcs()
+    std::vector<Arc>::iterator eps_end =
+        std::stable_partition(arcs.begin(), arcs.end(), IsEpsArc);
+    own_arc_offset_[i] = offset;
+    own_num_eps_arcs_[i] = eps_end - arcs.begin();
+    own_arcs_.insert(own_arcs_.end(), arcs.begin(), arcs.end());
+    offset += arcs.size();
   }
+  own_finals_.assign(all_arcs->size(), kNonFinalWeight);
+  std::map<int32_t, float>::const_iterator it = finals.begin();
+  for (; it != finals.end(); it++) {
+    CHECK(it->second != kNonFinalWeight);
+    own_finals_[it->first] = it->second;
+  }
+
+  num_states_ = own_arc_offset_.size();
+  num_arcs_ = own_arcs_.size();
+  num_finals_ = finals.size();
+  arc_offset_ = own_arc_offset_.data();
+  num_eps_arcs_ = own_num_eps_arcs_.data();
+  finals_ = own_finals_.data();
+  arcs_ = own_arcs_.data();
+}
 
-  char buffer[1024];
-  char ilabel[1024], olabel[1024];
-  bool first_line = true;
-  int32_t src, dest;
-  float weight = 0.0f;
+// A line of the topo file, an arc or a final state
+struct TopoLine {
+  bool is_final;
+  int32_t src, dest, ilabel, olabel;
+  float weight;
+};
 
-  std::vector<std::vector<Arc> > all_arcs;
-  while (fgets(buffer, 1024, fp)) {
-    int32_t num = sscanf(buffer, "%d %d %s %s %f",
-                         &src, &dest, ilabel, olabel, &weight);
-    if (num >= 4) {
-      if (num == 4) weight = 0;
-      if (first_line) {
-        first_line = false;
-        start_ = src;
-      }
-      Arc arc(isymbol_table.GetId(ilabel), osymbol_table.GetId(olabel),
-              weight, dest);
-      if (src >= static_cast<int32_t>(all_arcs.size()))
-        all_arcs.resize(src + 1);
-      if (dest >= static_cast<int32_t>(all_arcs.size()))
-        all_arcs.resize(dest + 1);
-      all_arcs[src].push_back(arc);
-    } else if (sscanf(buffer, "%d %f", &src, &weight) == 2) {
-      finals_[src] = weight;
-    } else if (sscanf(buffer, "%d", &src) == 1) {
-      finals_[src] = 0.0f;
+// Part of the topo file parsed by one thread
+struct TopoChunk {
+  const char *begin, *end;
+  const SymbolTable *isymbol_table, *osymbol_table;
+  std::vector<TopoLine> lines;
+};
+
+static int32_t ParseInt(const char *token, const char *line) {
+  char *end = NULL;
+  int32_t value = static_cast<int32_t>(strtol(token, &end, 10));
+  if (*end != '\0') ERROR("wrong number %s in line %s", token, line);
+  return value;
+}
+
+static float ParseFloat(const char *token, const char *line) {
+  char *end = NULL;
+  float value = strtof(token, &end);
+  if (*end != '\0') ERROR("wrong number %s in line %s", token, line);
+  return value;
+}
+
+static int32_t ParseLabel(const char *token, const SymbolTable *symbol_table,
+                          const char *line) {
+  if (symbol_table == NULL) return ParseInt(token, line);
+  int32_t id = symbol_table->GetId(token);
+  if (id < 0) ERROR("symbol %s not in the symbol table", token);
+  return id;
+}
+
+static void *ParseTopoChunk(void *arg) {
+  TopoChunk *chunk = reinterpret_cast<TopoChunk *>(arg);
+  const int kMaxTokens = 6;
+  char *tokens[kMaxTokens];
+  std::string line, buffer;
+  for (const char *p = chunk->begin; p < chunk->end;) {
+    const char *eol = std::find(p, chunk->end, '\n');
+    line.assign(p, eol);
+    p = eol + 1;
+    // split a copy, line is kept for the error message
+    buffer = line;
+    int num = 0;
+    char *save = NULL;
+    for (char *token = strtok_r(&buffer[0], " \t\r", &save);
+         token != NULL && num < kMaxTokens;
+         token = strtok_r(NULL, " \t\r", &save)) {
+      tokens[num++] = token;
+    }
+    if (num == 0) continue;
+    TopoLine topo_line;
+    if (num == 4 || num == 5) {
+      topo_line.is_final = false;
+      topo_line.src = ParseInt(tokens[0], line.c_str());
+      topo_line.dest = ParseInt(tokens[1], line.c_str());
+      topo_line.ilabel = ParseLabel(tokens[2], chunk->isymbol_table,
+                                    line.c_str());
+      topo_line.olabel = ParseLabel(tokens[3], chunk->osymbol_table,
+                                    line.c_str());
+      topo_line.weight = num == 5 ? ParseFloat(tokens[4], line.c_str()) : 0;
+    } else if (num == 1 || num == 2) {
+      topo_line.is_final = true;
+      topo_line.src = ParseInt(tokens[0], line.c_str());
+      topo_line.weight = num == 2 ? ParseFloat(tokens[1], line.c_str()) : 0;
+      // openfst prints the zero weight as Infinity
+      if (topo_line.weight == kNonFinalWeight) continue;
     } else {
       ERROR("wrong line, expected (src, dest, ilabel, olabel, weight) "
-            "or (final, weight) but get %s", buffer);
-      break;
+            "or (final, weight) but get %s", line.c_str());
     }
+    chunk->lines.push_back(topo_line);
   }
-  fclose(fp);
+  return NULL;
+}
 
-  arc_offset_.resize(all_arcs.size());
-  int32_t offset = 0;
-  for (uint32_t i = 0; i < all_arcs.size(); i++) {
-    arc_offset_[i] = offset;
-    arcs_.insert(arcs_.end(), all_arcs[i].begin(), all_arcs[i].end());
-    offset += all_arcs[i].size();
-  }
+void Fst::ReadTopo(const std::string& topo_file,
+                   const SymbolTable& isymbol_table,
+                   const SymbolTable& osymbol_table,
+                   int32_t num_threads) {
+  ReadTopo(topo_file, &isymbol_table, &osymbol_table, num_threads);
 }
 
 // For directly convert openfst file to xdecoder fst
-void Fst::ReadTopo(const std::string& topo_file) {
+void Fst::ReadTopo(const std::string& topo_file, int32_t num_threads) {
+  ReadTopo(topo_file, NULL, NULL, num_threads);
+}
+
+void Fst::ReadTopo(const std::string& topo_file,
+                   const SymbolTable *isymbol_table,
+                   const SymbolTable *osymbol_table,
+                   int32_t num_threads) {
   Reset();
-  FILE *fp = fopen(topo_file.c_str(), "r");
-  if (!fp) {
+  std::ifstream is(topo_file, std::ifstream::binary);
+  if (is.fail()) {
     ERROR("file %s not exist", topo_file.c_str());
   }
+  std::string text((std::istreambuf_iterator<char>(is)),
+                   std::istreambuf_iterator<char>());
 
-  char buffer[1024];
-  int32_t ilabel, olabel;
-  bool first_line = true;
-  int32_t src, dest;
-  float weight = 0.0f;
+  // Split the text into num_threads chunks at line boundaries
+  CHECK(num_threads > 0);
+  std::vector<TopoChunk> chunks(num_threads);
+  const char *begin = text.data(), *end = text.data() + text.size();
+  for (int32_t i = 0; i < num_threads; i++) {
+    const char *chunk_end = std::find(
+        begin + (end - begin) / (num_threads - i), end, '\n');
+    if (chunk_end != end) chunk_end++;
+    chunks[i].begin = begin;
+    chunks[i].end = chunk_end;
+    chunks[i].isymbol_table = isymbol_table;
+    chunks[i].osymbol_table = osymbol_table;
+    begin = chunk_end;
+  }
+  std::vector<pthread_t> tids(num_threads);
+  for (int32_t i = 1; i < num_threads; i++) {
+    if (pthread_create(&tids[i], NULL, ParseTopoChunk, &chunks[i]) != 0) {
+      ERROR("pthread %d create error", i);
+    }
+  }
+  ParseTopoChunk(&chunks[0]);
+  for (int32_t i = 1; i < num_threads; i++) {
+    pthread_join(tids[i], NULL);
+  }
 
+  // Merge in the order of the file, the source of the first arc is start
   std::vector<std::vector<Arc> > all_arcs;
-  while (fgets(buffer, 1024, fp)) {
-    int32_t num = sscanf(buffer, "%d %d %d %d %f",
-                         &src, &dest, &ilabel, &olabel, &weight);
-    if (num >= 4) {
-      if (num == 4) weight = 0;
-      if (first_line) {
-        first_line = false;
-        start_ = src;
+  std::map<int32_t, float> finals;
+  bool first_arc = true;
+  for (int32_t i = 0; i < num_threads; i++) {
+    const std::vector<TopoLine>& lines = chunks[i].lines;
+    for (size_t j = 0; j < lines.size(); j++) {
+      const TopoLine& line = lines[j];
+      if (line.is_final) {
+        finals[line.src] = line.weight;
+        continue;
       }
-      Arc arc(ilabel, olabel, weight, dest);
-      if (src >= static_cast<int32_t>(all_arcs.size()))
-        all_arcs.resize(src + 1);
-      if (dest >= static_cast<int32_t>(all_arcs.size()))
-        all_arcs.resize(dest + 1);
-      all_arcs[src].push_back(arc);
-    } else if (sscanf(buffer, "%d %f", &src, &weight) == 2) {
-      finals_[src] = weight;
-    } else if (sscanf(buffer, "%d", &src) == 1) {
-      finals_[src] = 0.0f;
-    } else {
-      ERROR("wrong line, expected (src, dest, ilabel, olabel, weight) "
-            "or (final, weight) but get %s", buffer);
-      break;
+      if (first_arc) {
+        first_arc = false;
+        start_ = line.src;
+      }
+      int32_t max_state = std::max(line.src, line.dest);
+      if (max_state >= static_cast<int32_t>(all_arcs.size()))
+        all_arcs.resize(max_state + 1);
+      all_arcs[line.src].push_back(Arc(line.ilabel, line.olabel,
+                                       line.weight, line.dest));
     }
+    std::vector<TopoLine>().swap(chunks[i].lines);
   }
-  fclose(fp);
+  Init(&all_arcs, finals);
+}
 
-  arc_offset_.resize(all_arcs.size());
-  int32_t offset = 0;
-  for (uint32_t i = 0; i < all_arcs.size(); i++) {
-    arc_offset_[i] = offset;
-    arcs_.insert(arcs_.end(), all_arcs[i].begin(), all_arcs[i].end());
-    offset += all_arcs[i].size();
+// The OpenFst binary format, see fst/fst.h, fst/vector-fst.h and
+// fst/const-fst.h of OpenFst. Only the standard arc type is supported,
+// whose layout is the same as Arc.
+const int32_t kOpenFstMagic = 2125659606;
+const int32_t kOpenFstSymbolTableMagic = 2125658996;
+const int32_t kOpenFstHasISymbols = 0x1;
+const int32_t kOpenFstHasOSymbols = 0x2;
+const int32_t kOpenFstIsAligned = 0x4;
+const int64_t kOpenFstAlign = 16;
+
+struct OpenFstConstState {
+  float weight;
+  uint32_t pos;
+  uint32_t num_arcs;
+  uint32_t num_ieps_arcs;
+  uint32_t num_oeps_arcs;
+};
+
+// ReadBasic() can not be used, it reads varint int32
+template <class T>
+static void ReadRaw(std::istream& is, T *t) {
+  is.read(reinterpret_cast<char *>(t), sizeof(T));
+}
+
+static std::string ReadOpenFstString(std::istream& is) {
+  int32_t size = 0;
+  ReadRaw(is, &size);
+  if (is.fail() || size < 0) ERROR("read openfst string error");
+  std::string str(size, '\0');
+  is.read(&str[0], size);
+  return str;
+}
+
+static void SkipOpenFstSymbolTable(std::istream& is) {
+  int32_t magic = 0;
+  ReadRaw(is, &magic);
+  if (magic != kOpenFstSymbolTableMagic) {
+    ERROR("unknown openfst symbol table format");
   }
+  ReadOpenFstString(is);  // name
+  int64_t available_key = 0, size = 0, key = 0;
+  ReadRaw(is, &available_key);
+  ReadRaw(is, &size);
+  for (int64_t i = 0; i < size && !is.fail(); i++) {
+    ReadOpenFstString(is);
+    ReadRaw(is, &key);
+  }
+}
+
+static void AlignOpenFstInput(std::istream& is) {
+  char c;
+  while (is.tellg() % kOpenFstAlign != 0 && !is.fail()) {
+    is.read(&c, 1);
+  }
+}
+
+bool Fst::IsOpenFst(const std::string& file) {
+  std::ifstream is(file, std::ifstream::binary);
+  int32_t magic = 0;
+  ReadRaw(is, &magic);
+  return !is.fail() && magic == kOpenFstMagic;
 }
 
+void Fst::ReadOpenFst(const std::string& file) {
+  Reset();
+  std::ifstream is(file, std::ifstream::binary);
+  if (is.fail()) {
+    ERROR("file %s not exist", file.c_str());
+  }
+  int32_t magic = 0, version = 0, flags = 0;
+  uint64_t properties = 0;
+  int64_t start = 0, num_states = 0, num_arcs = 0;
+  ReadRaw(is, &magic);
+  if (magic != kOpenFstMagic) {
+    ERROR("file %s is not an openfst binary fst", file.c_str());
+  }
+  std::string fst_type = ReadOpenFstString(is),
+              arc_type = ReadOpenFstString(is);
+  ReadRaw(is, &version);
+  ReadRaw(is, &flags);
+  ReadRaw(is, &properties);
+  ReadRaw(is, &start);
+  ReadRaw(is, &num_states);
+  ReadRaw(is, &num_arcs);
+  if (arc_type != "standard") {
+    ERROR("openfst arc type %s is not supported, standard expected",
+          arc_type.c_str());
+  }
+  if (flags & kOpenFstHasISymbols) SkipOpenFstSymbolTable(is);
+  if (flags & kOpenFstHasOSymbols) SkipOpenFstSymbolTable(is);
+  CHECK(num_states >= 0 && num_states < INT32_MAX);
 
+  std::vector<std::vector<Arc> > all_arcs(num_states);
+  std::map<int32_t, float> finals;
+  if (fst_type == "vector") {
+    for (int64_t s = 0; s < num_states && !is.fail(); s++) {
+      float weight = kNonFinalWeight;
+      int64_t num_state_arcs = 0;
+      ReadRaw(is, &weight);
+      ReadRaw(is, &num_state_arcs);
+      if (weight != kNonFinalWeight) finals[s] = weight;
+      all_arcs[s].resize(num_state_arcs);
+      is.read(reinterpret_cast<char *>(all_arcs[s].data()),
+              sizeof(Arc) * num_state_arcs);
+    }
+  } else if (fst_type == "const") {
+    std::vector<OpenFstConstState> states(num_states);
+    std::vector<Arc> arcs(num_arcs);
+    if (flags & kOpenFstIsAligned) AlignOpenFstInput(is);
+    is.read(reinterpret_cast<char *>(states.data()),
+            sizeof(OpenFstConstState) * num_states);
+    if (flags & kOpenFstIsAligned) AlignOpenFstInput(is);
+    is.read(reinterpret_cast<char *>(arcs.data()), sizeof(Arc) * num_arcs);
+    for (int64_t s = 0; s < num_states && !is.fail(); s++) {
+      const OpenFstConstState& state = states[s];
+      CHECK(state.pos + state.num_arcs <= arcs.size());
+      if (state.weight != kNonFinalWeight) finals[s] = state.weight;
+      all_arcs[s].assign(arcs.begin() + state.pos,
+                         arcs.begin() + state.pos + state.num_arcs);
+    }
+  } else {
+    ERROR("openfst type %s is not supported, vector or const expected",
+          fst_type.c_str());
+  }
+  if (is.fail()) {
+    ERROR("read openfst %s error, check!!!", file.c_str());
+  }
+  for (int64_t s = 0; s < num_states; s++) {
+    for (size_t i = 0; i < all_arcs[s].size(); i++) {
+      CHECK(all_arcs[s][i].next_state >= 0 &&
+            all_arcs[s][i].next_state < num_states);
+    }
+  }
+  start_ = start >= 0 ? start : 0;
+  Init(&all_arcs, finals);
+}
 
 // Show the text format fsm info
 void Fst::Info() const {
@@ -163,9 +398,8 @@ void Fst::Info() const {
   printf("num_arcs:\t%d\n", NumArcs());
   // final set info
   printf("final states:\t%d { ", NumFinals());
-  std::unordered_map<int32_t, float>::const_iterator it = finals_.begin();
-  for (; it != finals_.end(); it++) {
-    printf("(%d, %f) ", it->first, it->second);
+  for (int32_t i = 0; i < num_states_; i++) {
+    if (IsFinal(i)) printf("(%d, %f) ", i, Final(i));
   }
   printf("}\n");
 
@@ -182,35 +416,58 @@ void Fst::Info() const {
   }
 }
 
+int32_t Fst::MaxIlabel() const {
+  int32_t max_ilabel = 0;
+  for (int32_t i = 0; i < num_arcs_; i++) {
+    max_ilabel = std::max(max_ilabel, arcs_[i].ilabel);
+  }
+  return max_ilabel;
+}
+
+// Arcs are mapped from the file as they are
+static_assert(sizeof(Arc) == 16, "unexpected Arc layout");
+
 void Fst::Read(const std::string& filename) {
   Reset();
-  std::ifstream is(filename, std::ifstream::binary);
-  if (is.fail()) {
-    ERROR("read file %s error, check!!!", filename.c_str());
-  }
-  int32_t num_states, num_finals, num_arcs;
-  ReadBasic(is, &start_);
-  ReadBasic(is, &num_states);
-  ReadBasic(is, &num_finals);
-  ReadBasic(is, &num_arcs);
-
-  arc_offset_.resize(num_states);
-  for (int i = 0; i < num_states; i++) {
-    ReadBasic(is, &arc_offset_[i]);
+  mapped_file_.Map(filename);
+  if (mapped_file_.Size() < sizeof(FstHeader)) {
+    ERROR("file %s is not a fst, check!!!", filename.c_str());
   }
-
-  for (int i = 0; i < num_finals; i++) {
-    int32_t state;
-    float weight;
-    ReadBasic(is, &state);
-    ReadBasic(is, &weight);
-    finals_[state] = weight;
+  const char *data = mapped_file_.Data();
+  const FstHeader *header = reinterpret_cast<const FstHeader *>(data);
+  if (memcmp(header->magic, kFstMagic, sizeof(kFstMagic)) != 0) {
+    ERROR("file %s is not a fst or is of an old format, please convert it "
+          "by fst-init again", filename.c_str());
   }
-
-  arcs_.resize(num_arcs);
-  for (int i = 0; i < num_arcs; i++) {
-    arcs_[i].Read(is);
+  if (header->version != kFstVersion) {
+    ERROR("fst %s version %d, expected %d", filename.c_str(),
+          header->version, kFstVersion);
   }
+  CHECK(header->file_size == static_cast<int64_t>(mapped_file_.Size()));
+  // A corrupt header must not point outside the mapping
+  CHECK(header->num_states >= 0 && header->num_arcs >= 0 &&
+        header->num_finals >= 0);
+  CHECK(header->start >= 0 &&
+        (header->start < header->num_states || header->num_states == 0));
+  int64_t states_size = sizeof(int32_t) * header->num_states,
+          finals_size = sizeof(float) * header->num_states,
+          arcs_size = sizeof(Arc) * header->num_arcs;
+  CHECK(IsValidSection(header->arc_offset_pos, states_size,
+                       header->file_size));
+  CHECK(IsValidSection(header->num_eps_arcs_pos, states_size,
+                       header->file_size));
+  CHECK(IsValidSection(header->finals_pos, finals_size, header->file_size));
+  CHECK(IsValidSection(header->arcs_pos, arcs_size, header->file_size));
+  start_ = header->start;
+  num_states_ = header->num_states;
+  num_arcs_ = header->num_arcs;
+  num_finals_ = header->num_finals;
+  arc_offset_ = reinterpret_cast<const int32_t *>(
+      data + header->arc_offset_pos);
+  num_eps_arcs_ = reinterpret_cast<const int32_t *>(
+      data + header->num_eps_arcs_pos);
+  finals_ = reinterpret_cast<const float *>(data + header->finals_pos);
+  arcs_ = reinterpret_cast<const Arc *>(data + header->arcs_pos);
 }
 
 void Fst::Write(const std::string& filename) const {
@@ -219,27 +476,53 @@ void Fst::Write(const std::string& filename) const {
     ERROR("write file %s error, check!!!", filename.c_str());
   }
 
-  int32_t num_states = NumStates(),
-          num_finals = NumFinals(),
-          num_arcs = NumArcs();
-  WriteBasic(os, start_);
-  WriteBasic(os, num_states);
-  WriteBasic(os, num_finals);
-  WriteBasic(os, num_arcs);
+  FstHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kFstMagic, sizeof(kFstMagic));
+  header.version = kFstVersion;
+  header.start = start_;
+  header.num_states = num_states_;
+  header.num_arcs = num_arcs_;
+  header.num_finals = num_finals_;
+  int64_t states_size = sizeof(int32_t) * num_states_,
+          finals_size = sizeof(float) * num_states_,
+          arcs_size = sizeof(Arc) * num_arcs_;
+  header.arc_offset_pos = AlignSection(sizeof(header));
+  header.num_eps_arcs_pos = AlignSection(header.arc_offset_pos + states_size);
+  header.finals_pos = AlignSection(header.num_eps_arcs_pos + states_size);
+  header.arcs_pos = AlignSection(header.finals_pos + finals_size);
+  header.file_size = header.arcs_pos + arcs_size;
 
-  for (int i = 0; i < num_states; i++) {
-    WriteBasic(os, arc_offset_[i]);
-  }
-
-  std::unordered_map<int, float>::const_iterator it = finals_.begin();
-  for (; it != finals_.end(); it++) {
-    WriteBasic(os, it->first);
-    WriteBasic(os, it->second);
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  WriteSection(os, header.arc_offset_pos, arc_offset_, states_size);
+  WriteSection(os, header.num_eps_arcs_pos, num_eps_arcs_, states_size);
+  WriteSection(os, header.finals_pos, finals_, finals_size);
+  WriteSection(os, header.arcs_pos, arcs_, arcs_size);
+  if (os.fail()) {
+    ERROR("write file %s error, check!!!", filename.c_str());
   }
+}
 
-  for (int i = 0; i < num_arcs; i++) {
-    arcs_[i].Write(os);
+void Fst::Renumber(const std::vector<int32_t> &new_ids) {
+  CHECK(static_cast<int32_t>(new_ids.size()) == num_states_);
+  std::vector<std::vector<Arc> > all_arcs(num_states_);
+  std::map<int32_t, float> finals;
+  std::vector<bool> used(num_states_, false);
+  for (int32_t i = 0; i < num_states_; i++) {
+    int32_t id = new_ids[i];
+    CHECK(id >= 0 && id < num_states_ && !used[id]);
+    used[id] = true;
+    for (const Arc *arc = ArcStart(i); arc != ArcEnd(i); arc++) {
+      all_arcs[id].push_back(Arc(arc->ilabel, arc->olabel, arc->weight,
+                                 new_ids[arc->next_state]));
+    }
+    if (IsFinal(i)) finals[id] = Final(i);
   }
+  int32_t start = new_ids[start_];
+  // the views may point into the mapped file, so release it only now
+  Reset();
+  start_ = start;
+  Init(&all_arcs, finals);
 }
 
 void Fst::Dot(const SymbolTable& isymbol_table,
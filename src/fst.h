@@ -23,10 +23,13 @@
 #include <string>
 #include <iostream>
 #include <algorithm>
-#include <unordered_map>
+#include <map>
+#include <limits>
 
 #include "utils.h"
 #include "symbol-table.h"
+#include "mapped-file.h"
+#include "huge-page.h"
 
 namespace xdecoder {
 
@@ -49,15 +52,57 @@ struct Arc {
   int32_t next_state;
 };
 
+// Arcs of a state, see Fst::EpsArcs() and Fst::EmittingArcs()
+struct ArcRange {
+  ArcRange(const Arc *begin, const Arc *end): begin_(begin), end_(end) {}
+  const Arc *begin() const { return begin_; }
+  const Arc *end() const { return end_; }
+  int32_t size() const { return static_cast<int32_t>(end_ - begin_); }
+ private:
+  const Arc *begin_, *end_;
+};
+
+// Final weight of the states which are not final
+const float kNonFinalWeight = std::numeric_limits<float>::infinity();
+
+// The binary format of Fst is laid out to be mmap-ed directly: a header,
+// then the sections of arc offsets, epsilon arc counts, finals and arcs, each
+// aligned to kSectionAlign bytes, all in native byte order.
+const char kFstMagic[8] = "xdfst";
+const int32_t kFstVersion = 2;
+
+struct FstHeader {
+  char magic[8];
+  int32_t version;
+  int32_t start;
+  int32_t num_states;
+  int32_t num_arcs;
+  int32_t num_finals;
+  int32_t reserved;
+  // byte position of every section in the file
+  int64_t arc_offset_pos;
+  int64_t num_eps_arcs_pos;
+  int64_t finals_pos;
+  int64_t arcs_pos;
+  int64_t file_size;
+};
+
 class Fst {
  public:
-  Fst(): start_(0) {}
+  Fst() {
+    Reset();
+  }
   explicit Fst(const std::string& file) {
+    Reset();
     Read(file);
   }
-  // ~Fst();
+  ~Fst() {
+    Reset();
+  }
   void Reset();
   void Info() const;
+  // The largest ilabel, the decoder indexes the frame costs by it
+  int32_t MaxIlabel() const;
 
   int32_t Start() const {
     return start_;
@@ -68,66 +113,150 @@ class Fst {
   }
 
   int32_t NumFinals() const {
-    return finals_.size();
+    return num_finals_;
   }
 
   int32_t NumArcs() const {
-    return arcs_.size();
+    return num_arcs_;
   }
 
   int32_t NumStates() const {
-    return arc_offset_.size();
+    return num_states_;
   }
 
   bool IsFinal(int32_t id) const {
-    return (finals_.find(id) != finals_.end());
+    return finals_[id] != kNonFinalWeight;
   }
 
+  // kNonFinalWeight if id is not final
   float Final(int32_t id) const {
-    if (IsFinal(id)) {
-      return finals_.at(id);
-    } else {
-      return 0.0f;
-    }
+    return finals_[id];
   }
 
   int32_t NumArcs(int32_t id) const {
     if (id < NumStates() - 1) {
       return arc_offset_[id + 1] - arc_offset_[id];
     } else {
-      return arcs_.size() - arc_offset_[id];
+      return num_arcs_ - arc_offset_[id];
     }
   }
 
   const Arc *ArcStart(int32_t id) const {
     CHECK(id < NumStates());
-    return arcs_.data() + arc_offset_[id];
+    return arcs_ + arc_offset_[id];
   }
 
   const Arc *ArcEnd(int32_t id) const {
     CHECK(id < NumStates());
     if (id < NumStates() - 1) {
-      return arcs_.data() + arc_offset_[id + 1];
+      return arcs_ + arc_offset_[id + 1];
     } else {
-      return arcs_.data() + arcs_.size();
+      return arcs_ + num_arcs_;
     }
   }
 
+  // Arcs of a state are stored with the epsilon (ilabel 0) arcs first,
+  // so the two kinds of arcs can be visited separately
+  int32_t NumEpsArcs(int32_t id) const {
+    return num_eps_arcs_[id];
+  }
+
+  ArcRange EpsArcs(int32_t id) const {
+    const Arc *start = ArcStart(id);
+    return ArcRange(start, start + num_eps_arcs_[id]);
+  }
+
+  ArcRange EmittingArcs(int32_t id) const {
+    return ArcRange(ArcStart(id) + num_eps_arcs_[id], ArcEnd(id));
+  }
+
+  // Index of the arc in all arcs, GetArc() is the inverse of it
+  int32_t ArcIndex(const Arc *arc) const {
+    return static_cast<int32_t>(arc - arcs_);
+  }
+
+  const Arc& GetArc(int32_t index) const {
+    return arcs_[index];
+  }
+
+  int32_t OLabel(int32_t index) const {
+    return arcs_[index].olabel;
+  }
+
+  // Iterates over the epsilon or the emitting arcs of a state. It has the
+  // same interface as CompressedFst::ArcIterator, so that FasterDecoder
+  // can search either of them.
+  class ArcIterator {
+   public:
+    ArcIterator(const Fst& fst, int32_t state, bool eps): base_(fst.arcs_) {
+      ArcRange arcs = eps ? fst.EpsArcs(state) : fst.EmittingArcs(state);
+      it_ = arcs.begin();
+      end_ = arcs.end();
+    }
+    bool Done() const { return it_ == end_; }
+    void Next() { it_++; }
+    const Arc& Value() const { return *it_; }
+    int32_t Index() const { return static_cast<int32_t>(it_ - base_); }
+
+   private:
+    const Arc *base_, *it_, *end_;
+  };
+
+  // Reads the text format of openfst, the labels are symbols of the symbol
+  // tables, the topo file is parsed by num_threads threads
   void ReadTopo(const std::string& topo_file,
                 const SymbolTable& isymbol_table,
-                const SymbolTable& osymbol_table);
-  void ReadTopo(const std::string& topo_file);
+                const SymbolTable& osymbol_table,
+                int32_t num_threads = 1);
+  // The labels are ids, like the output of fstprint
+  void ReadTopo(const std::string& topo_file, int32_t num_threads = 1);
+  // Reads the openfst binary vector or const fst of the standard arc type,
+  // eg. the HCLG.fst of kaldi
+  void ReadOpenFst(const std::string& file);
+  static bool IsOpenFst(const std::string& file);
 
+  // Read() maps the file read-only, no copy is made, and processes using
+  // the same file share the pages of it
   void Read(const std::string& file);
   void Write(const std::string& file) const;
   void Dot(const SymbolTable& isymbol_table,
            const SymbolTable& osymbol_table) const;
+  // Size of the arcs and how much of them huge pages back, see huge-page.h
+  std::string HugePageReport() const {
+    return xdecoder::HugePageReport("fst arcs", arcs_,
+                                    sizeof(Arc) * num_arcs_);
+  }
+  // Renumbers state i to new_ids[i], new_ids must be a permutation
+  void Renumber(const std::vector<int32_t> &new_ids);
+  // Builds the fst from the arcs of every state, used by the readers above
+  // and by the tools which rewrite the graph. It concatenates the arcs,
+  // epsilon arcs first in each state, and the finals into the own_*
+  // buffers, the start state is set by SetStart().
+  void Init(std::vector<std::vector<Arc> > *all_arcs,
+            const std::map<int32_t, float> &finals);
 
  private:
+  // symbol tables are NULL if the labels are ids
+  void ReadTopo(const std::string& topo_file,
+                const SymbolTable *isymbol_table,
+                const SymbolTable *osymbol_table,
+                int32_t num_threads);
+
   int32_t start_;
-  std::vector<int32_t> arc_offset_;  // arc offset of state
-  std::unordered_map<int32_t, float> finals_;
-  std::vector<Arc> arcs_;
+  int32_t num_states_, num_arcs_, num_finals_;
+  // Read-only views of the fst, they point into the own_* buffers when the
+  // fst is built by ReadTopo(), or into the mapped file after Read()
+  const int32_t *arc_offset_;  // arc offset of state
+  const int32_t *num_eps_arcs_;  // number of epsilon arcs of state
+  const float *finals_;  // final weight of state
+  const Arc *arcs_;
+
+  HugePageVector<int32_t> own_arc_offset_;
+  HugePageVector<int32_t> own_num_eps_arcs_;
+  HugePageVector<float> own_finals_;
+  HugePageVector<Arc> own_arcs_;
+
+  MappedFile mapped_file_;
   DISALLOW_COPY_AND_ASSIGN(Fst);
 };
 
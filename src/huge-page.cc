@@ -0,0 +1,135 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <set>
+
+#include "huge-page.h"
+#include "utils.h"
+
+namespace xdecoder {
+
+static bool use_huge_pages = false;
+
+void SetUseHugePages(bool use) {
+  use_huge_pages = use;
+}
+
+bool UseHugePages() {
+  return use_huge_pages;
+}
+
+static size_t RoundUp(size_t size) {
+  return (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+}
+
+void *HugePageAlloc(size_t size) {
+  size = RoundUp(size);
+  void *addr = MAP_FAILED;
+  if (use_huge_pages) {
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) return addr;
+  }
+  // Over allocate to align to kHugePageSize, transparent huge pages only
+  // back the aligned 2MB ranges
+  size_t map_size = size + kHugePageSize;
+  char *base = reinterpret_cast<char *>(mmap(NULL, map_size,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (base == MAP_FAILED) {
+    ERROR("mmap %zu bytes error", size);
+  }
+  char *aligned = reinterpret_cast<char *>(
+      RoundUp(reinterpret_cast<uintptr_t>(base)));
+  if (aligned > base) munmap(base, aligned - base);
+  munmap(aligned + size, base + map_size - (aligned + size));
+#ifdef MADV_HUGEPAGE
+  if (use_huge_pages) madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+  return aligned;
+}
+
+void HugePageFree(void *addr, size_t size) {
+  if (addr != NULL) munmap(addr, RoundUp(size));
+}
+
+// Addresses of the live huge page allocations of AllocMaybeHuge(), never
+// destructed, so the vectors of static objects can still be freed at exit
+static std::set<void *> *huge_allocs = new std::set<void *>();
+static pthread_mutex_t huge_allocs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void *AllocMaybeHuge(size_t size) {
+  if (size < kHugePageSize || !use_huge_pages) return ::operator new(size);
+  void *addr = HugePageAlloc(size);
+  pthread_mutex_lock(&huge_allocs_mutex);
+  huge_allocs->insert(addr);
+  pthread_mutex_unlock(&huge_allocs_mutex);
+  return addr;
+}
+
+void FreeMaybeHuge(void *addr, size_t size) {
+  // Only the big allocations may be huge page ones
+  bool huge = false;
+  if (size >= kHugePageSize) {
+    pthread_mutex_lock(&huge_allocs_mutex);
+    huge = huge_allocs->erase(addr) > 0;
+    pthread_mutex_unlock(&huge_allocs_mutex);
+  }
+  if (huge) {
+    HugePageFree(addr, size);
+  } else {
+    ::operator delete(addr);
+  }
+}
+
+size_t HugePageBytes(const void *addr, size_t size) {
+  FILE *fp = fopen("/proc/self/smaps", "r");
+  if (fp == NULL) return 0;
+  uintptr_t begin = reinterpret_cast<uintptr_t>(addr), end = begin + size;
+  uintptr_t vma_begin = 0, vma_end = 0;
+  double bytes = 0.0;
+  char line[1024];
+  while (fgets(line, sizeof(line), fp)) {
+    unsigned long start = 0, stop = 0, kb = 0;  // NOLINT
+    if (sscanf(line, "%lx-%lx ", &start, &stop) == 2) {
+      vma_begin = start;
+      vma_end = stop;
+      continue;
+    }
+    if (vma_end <= begin || vma_begin >= end) continue;
+    if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+        sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1 ||
+        sscanf(line, "Shared_Hugetlb: %lu kB", &kb) == 1 ||
+        sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1) {
+      uintptr_t overlap = std::min(vma_end, end) - std::max(vma_begin, begin);
+      bytes += kb * 1024.0 * overlap / (vma_end - vma_begin);
+    }
+  }
+  fclose(fp);
+  return static_cast<size_t>(bytes);
+}
+
+std::string HugePageReport(const char *name, const void *addr, size_t size) {
+  char buffer[1024];
+  snprintf(buffer, sizeof(buffer), "%s %.1fMB, huge pages %.1fMB", name,
+           size / 1048576.0, HugePageBytes(addr, size) / 1048576.0);
+  return buffer;
+}
+
+}  // namespace xdecoder
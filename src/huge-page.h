@@ -0,0 +1,91 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HUGE_PAGE_H_
+#define HUGE_PAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <string>
+#include <vector>
+
+namespace xdecoder {
+
+// Huge page backed memory for the big structures which are accessed at
+// random, eg. the arcs of the graph and the token pool, to save the TLB
+// misses. It is opt-in, see SetUseHugePages().
+
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+// Off by default, call it before the structures are allocated
+void SetUseHugePages(bool use_huge_pages);
+bool UseHugePages();
+
+// Allocates size bytes by mmap, zero filled and aligned to kHugePageSize.
+// If UseHugePages(), it tries explicit huge pages (MAP_HUGETLB, which needs
+// pages reserved in /proc/sys/vm/nr_hugepages) first, then transparent huge
+// pages by madvise(MADV_HUGEPAGE), the kernel may still give normal pages.
+void *HugePageAlloc(size_t size);
+void HugePageFree(void *addr, size_t size);
+
+// Bytes of [addr, addr + size) backed by huge pages, from /proc/self/smaps.
+// smaps counts per mapping, so a mapping only partly in the range is
+// counted in proportion.
+size_t HugePageBytes(const void *addr, size_t size);
+
+// eg. "arcs 96.0MB, huge pages 94.0MB"
+std::string HugePageReport(const char *name, const void *addr, size_t size);
+
+// Allocations of at least kHugePageSize go to HugePageAlloc() if
+// UseHugePages(), the others to ::operator new. The huge page ones are
+// recorded, so FreeMaybeHuge() frees every allocation the way it was made,
+// even if SetUseHugePages() is called in between.
+void *AllocMaybeHuge(size_t size);
+void FreeMaybeHuge(void *addr, size_t size);
+
+// STL allocator by AllocMaybeHuge()
+template <class T>
+struct HugePageAllocator {
+  typedef T value_type;
+  HugePageAllocator() {}
+  template <class U>
+  HugePageAllocator(const HugePageAllocator<U>&) {}  // NOLINT
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(AllocMaybeHuge(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) {
+    FreeMaybeHuge(p, n * sizeof(T));
+  }
+};
+
+template <class T, class U>
+bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) {
+  return false;
+}
+
+template <class T>
+using HugePageVector = std::vector<T, HugePageAllocator<T> >;
+
+}  // namespace xdecoder
+
+#endif  // HUGE_PAGE_H_
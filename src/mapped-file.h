@@ -0,0 +1,124 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+#include "utils.h"
+#include "huge-page.h"
+
+namespace xdecoder {
+
+// Maps a file read-only, processes mapping the same file share its pages.
+// If UseHugePages(), the file is read into huge pages instead, page cache
+// pages can't be huge, then each process has its own copy.
+class MappedFile {
+ public:
+  MappedFile(): addr_(NULL), size_(0), copied_(false) {}
+  ~MappedFile() { Unmap(); }
+
+  void Map(const std::string& filename) {
+    Unmap();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      ERROR("read file %s error, check!!!", filename.c_str());
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ERROR("stat file %s error, check!!!", filename.c_str());
+    }
+    if (st.st_size > 0 && UseHugePages()) {
+      char *addr = reinterpret_cast<char *>(HugePageAlloc(st.st_size));
+      for (off_t pos = 0; pos < st.st_size;) {
+        ssize_t n = read(fd, addr + pos, st.st_size - pos);
+        if (n <= 0) {
+          ERROR("read file %s error, check!!!", filename.c_str());
+        }
+        pos += n;
+      }
+      addr_ = addr;
+      size_ = st.st_size;
+      copied_ = true;
+    } else if (st.st_size > 0) {
+      void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED) {
+        ERROR("mmap file %s error, check!!!", filename.c_str());
+      }
+      addr_ = addr;
+      size_ = st.st_size;
+    }
+    close(fd);  // the mapping keeps the file
+  }
+
+  void Unmap() {
+    if (addr_ != NULL) {
+      if (copied_) {
+        HugePageFree(addr_, size_);
+      } else {
+        munmap(addr_, size_);
+      }
+      copied_ = false;
+      addr_ = NULL;
+      size_ = 0;
+    }
+  }
+
+  const char *Data() const { return reinterpret_cast<const char *>(addr_); }
+  size_t Size() const { return size_; }
+
+ private:
+  void *addr_;
+  size_t size_;
+  bool copied_;  // read into huge pages rather than mapped
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+// Binary formats made to be mapped (eg. Fst) align their sections to
+// kSectionAlign bytes
+const int64_t kSectionAlign = 64;
+
+inline int64_t AlignSection(int64_t pos) {
+  return (pos + kSectionAlign - 1) / kSectionAlign * kSectionAlign;
+}
+
+// Whether the section of size bytes at pos is aligned and inside the file,
+// the readers check it before pointing into the mapping
+inline bool IsValidSection(int64_t pos, int64_t size, int64_t file_size) {
+  return pos >= 0 && pos % kSectionAlign == 0 && size >= 0 &&
+         pos <= file_size && size <= file_size - pos;
+}
+
+// Writes the section of size bytes at pos, padding zeros before it
+inline void WriteSection(std::ostream& os, int64_t pos,
+                         const void *section, int64_t size) {
+  static const char zeros[kSectionAlign] = {0};
+  int64_t cur = os.tellp();
+  CHECK(cur <= pos && pos - cur < kSectionAlign);
+  os.write(zeros, pos - cur);
+  os.write(reinterpret_cast<const char *>(section), size);
+}
+
+}  // namespace xdecoder
+
+#endif  // MAPPED_FILE_H_
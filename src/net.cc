@@ -17,8 +17,15 @@
 #include <cblas.h>
 #endif   // USE_BLAS
 #include <math.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
 
 #include <tuple>
+#include <limits>
 #include <algorithm>
 
 #include "net.h"
@@ -206,6 +213,9 @@ void ChooseQuantizationParams(float min, float max, float* scale,
                               uint8_t* zero_point) {
   min = std::min(min, 0.f);
   max = std::max(max, 0.f);
+  // all zeros, eg. a dead relu output, would give scale 0
+  const float min_range = 1e-6f;
+  if (max - min < min_range) max = min + min_range;
   // the min and max quantized values, as floating-point values
   const float qmin = 0;
   const float qmax = 255;
@@ -224,18 +234,23 @@ void ChooseQuantizationParams(float min, float max, float* scale,
   *scale = scale_double;
 }
 
-void QuantizeData(const float* src, int n, float* scale, uint8_t* zero_point,
+void QuantizeData(const float* src, int n, float scale, uint8_t zero_point,
                   uint8_t* dest) {
-  float min, max;
-  FindMinMax(src, n, &min, &max);
-  ChooseQuantizationParams(min, max, scale, zero_point);
   for (int i = 0; i < n; i++) {
-    float point = (*zero_point) + src[i] / (*scale);
+    float point = zero_point + src[i] / scale;
     float round_point = std::max(0.f, std::min(255.f, point));
     dest[i] = static_cast<uint8_t>(round(round_point));
   }
 }
 
+void QuantizeData(const float* src, int n, float* scale, uint8_t* zero_point,
+                  uint8_t* dest) {
+  float min, max;
+  FindMinMax(src, n, &min, &max);
+  ChooseQuantizationParams(min, max, scale, zero_point);
+  QuantizeData(src, n, *scale, *zero_point, dest);
+}
+
 template <typename DType>
 void DequantizeData(DType* src, int n, float scale, uint8_t zero_point,
                     float* dest) {
@@ -244,16 +259,294 @@ void DequantizeData(DType* src, int n, float scale, uint8_t zero_point,
   }
 }
 
+
+/* Activation Functions */
+
+#ifdef __SSE4_1__
+// exp(x) of 4 floats, the range reduction and polynomial of Cephes expf,
+// about 2 ulp error for x in [-87, 88]
+static inline __m128 ExpPs(__m128 x) {
+  const __m128 max_x = _mm_set1_ps(88.3762626647949f);
+  const __m128 min_x = _mm_set1_ps(-87.3365447505531f);
+  x = _mm_max_ps(_mm_min_ps(x, max_x), min_x);
+  // x = n * ln2 + r, |r| <= ln2 / 2
+  __m128 n = _mm_floor_ps(_mm_add_ps(
+      _mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+  __m128 y = _mm_set1_ps(1.9875691500e-4f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+  y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, x), x),
+                 _mm_add_ps(x, _mm_set1_ps(1.0f)));
+  // 2^n by the exponent bits
+  __m128i pow2n = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n),
+                                               _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(y, _mm_castsi128_ps(pow2n));
+}
+
+static inline __m128 SigmoidPs(__m128 x) {
+  const __m128 one = _mm_set1_ps(1.0f);
+  return _mm_div_ps(one, _mm_add_ps(one, ExpPs(_mm_sub_ps(_mm_setzero_ps(),
+                                                          x))));
+}
+
+// tanh(x) = 2 * sigmoid(2x) - 1
+static inline __m128 TanhPs(__m128 x) {
+  const __m128 two = _mm_set1_ps(2.0f);
+  return _mm_sub_ps(_mm_mul_ps(two, SigmoidPs(_mm_mul_ps(two, x))),
+                    _mm_set1_ps(1.0f));
+}
+
+// Applies Func to 4 floats at a time, the tail is padded, so every element
+// gets the same approximation
+template <__m128 (*Func)(__m128)>
+static void ApplyPs(const float* src, int n, float* dest) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dest + i, Func(_mm_loadu_ps(src + i)));
+  }
+  if (i < n) {
+    float buf[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    memcpy(buf, src + i, sizeof(float) * (n - i));
+    _mm_storeu_ps(buf, Func(_mm_loadu_ps(buf)));
+    memcpy(dest + i, buf, sizeof(float) * (n - i));
+  }
+}
+
+static inline __m128 ReLUPs(__m128 x) {
+  return _mm_max_ps(x, _mm_setzero_ps());
+}
+
+void ReLUData(const float* src, int n, float* dest) {
+  ApplyPs<ReLUPs>(src, n, dest);
+}
+
+void SigmoidData(const float* src, int n, float* dest) {
+  ApplyPs<SigmoidPs>(src, n, dest);
+}
+
+void TanhData(const float* src, int n, float* dest) {
+  ApplyPs<TanhPs>(src, n, dest);
+}
+
+// Horizontal max/sum of the 4 floats
+static inline float MaxPs(__m128 x) {
+  x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+  x = _mm_max_ss(x, _mm_shuffle_ps(x, x, 1));
+  return _mm_cvtss_f32(x);
+}
+
+static inline float SumPs(__m128 x) {
+  x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+  x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+  return _mm_cvtss_f32(x);
+}
+
+void SoftmaxData(const float* src, int n, float* dest) {
+  CHECK(n > 0);
+  __m128 max4 = _mm_set1_ps(src[0]);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) max4 = _mm_max_ps(max4, _mm_loadu_ps(src + i));
+  float max = MaxPs(max4);
+  for (; i < n; i++) max = std::max(max, src[i]);
+
+  // exp(x - max) and its sum, the tail is zero padded into buf, only its
+  // first n - i lanes are stored and summed
+  __m128 sum4 = _mm_setzero_ps(), max_ps = _mm_set1_ps(max);
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128 y = ExpPs(_mm_sub_ps(_mm_loadu_ps(src + i), max_ps));
+    sum4 = _mm_add_ps(sum4, y);
+    _mm_storeu_ps(dest + i, y);
+  }
+  float sum = SumPs(sum4);
+  if (i < n) {
+    float buf[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    memcpy(buf, src + i, sizeof(float) * (n - i));
+    _mm_storeu_ps(buf, ExpPs(_mm_sub_ps(_mm_loadu_ps(buf), max_ps)));
+    for (int j = 0; j < n - i; j++) {
+      dest[i + j] = buf[j];
+      sum += buf[j];
+    }
+  }
+  __m128 scale = _mm_set1_ps(1.0f / sum);
+  for (i = 0; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_loadu_ps(dest + i), scale));
+  }
+  for (; i < n; i++) dest[i] /= sum;
+}
+#else
+void ReLUData(const float* src, int n, float* dest) {
+  for (int i = 0; i < n; i++) dest[i] = std::max(src[i], 0.0f);
+}
+
+void SigmoidData(const float* src, int n, float* dest) {
+  for (int i = 0; i < n; i++) dest[i] = 1.0 / (1 + exp(-src[i]));
+}
+
+void TanhData(const float* src, int n, float* dest) {
+  for (int i = 0; i < n; i++) dest[i] = tanh(src[i]);
+}
+
+void SoftmaxData(const float* src, int n, float* dest) {
+  float max = src[0], sum = 0.0;
+  for (int i = 1; i < n; i++) max = std::max(src[i], max);
+  for (int i = 0; i < n; i++) sum += dest[i] = exp(src[i] - max);
+  for (int i = 0; i < n; i++) dest[i] /= sum;
+}
+#endif  // __SSE4_1__
+
+void QuantizeSymmetricData(const float* src, int n, float* scale,
+                           int8_t* dest) {
+  float max = 0.0f;
+  for (int i = 0; i < n; i++) max = std::max(max, fabsf(src[i]));
+  *scale = max > 0.0f ? max / 127 : 1.0f;
+  float inv_scale = 1.0f / *scale;
+  for (int i = 0; i < n; i++) {
+    float point = std::max(-127.f, std::min(127.f, src[i] * inv_scale));
+    dest[i] = static_cast<int8_t>(round(point));
+  }
+}
+
+void QuantizeInt8Data(const float* src, int n, float* scale,
+                      int32_t* zero_point, int8_t* dest) {
+  float min, max;
+  FindMinMax(src, n, &min, &max);
+  *scale = max > min ? (max - min) / 254 : 1.0f;
+  // a narrow range far from 0 gives a huge zero point, include 0 in the
+  // range then, so it stays small
+  if (fabs(min / *scale) > 65536) {
+    min = std::min(min, 0.f);
+    max = std::max(max, 0.f);
+    *scale = max > min ? (max - min) / 254 : 1.0f;
+  }
+  *zero_point = static_cast<int32_t>(round(-127 - min / *scale));
+  float inv_scale = 1.0f / *scale;
+  for (int i = 0; i < n; i++) {
+    float point = std::max(-127.f, std::min(127.f,
+                                            src[i] * inv_scale + *zero_point));
+    dest[i] = static_cast<int8_t>(round(point));
+  }
+}
+
+static int32_t DotInt8(const int8_t* x, const int8_t* w, int n) {
+  int32_t sum = 0;
+  for (int k = 0; k < n; k++) sum += x[k] * w[k];
+  return sum;
+}
+
+#ifdef __AVX2__
+// acc += 4 sums of the adjacent products of the bytes of x_abs (uint8) and
+// w (int8) of every int32 lane
+static inline __m256i MulAddInt8(__m256i acc, __m256i x_abs, __m256i w) {
+#if defined(__AVXVNNI__)
+  return _mm256_dpbusd_avx_epi32(acc, x_abs, w);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+  return _mm256_dpbusd_epi32(acc, x_abs, w);
+#else
+  __m256i pairs = _mm256_maddubs_epi16(x_abs, w);
+  return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs,
+                                                 _mm256_set1_epi16(1)));
+#endif
+}
+
+// Dot products of x and the 4 rows of w, stride apart, of n int8 values, n
+// is a multiple of kInt8Align. pmaddubsw takes uint8 * int8, so it is
+// |x| * (w with the sign of x).
+static void DotInt8x4(const int8_t* x, const int8_t* w, int stride, int n,
+                      int32_t* out) {
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256(),
+          acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+  for (int k = 0; k < n; k += 32) {
+    __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + k));
+    __m256i x_abs = _mm256_abs_epi8(xv);
+    const int8_t* wk = w + k;
+    acc0 = MulAddInt8(acc0, x_abs, _mm256_sign_epi8(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(wk)), xv));
+    acc1 = MulAddInt8(acc1, x_abs, _mm256_sign_epi8(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(wk + stride)), xv));
+    acc2 = MulAddInt8(acc2, x_abs, _mm256_sign_epi8(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(wk + 2 * stride)), xv));
+    acc3 = MulAddInt8(acc3, x_abs, _mm256_sign_epi8(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(wk + 3 * stride)), xv));
+  }
+  __m256i sum = _mm256_hadd_epi32(_mm256_hadd_epi32(acc0, acc1),
+                                  _mm256_hadd_epi32(acc2, acc3));
+  __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                               _mm256_extracti128_si256(sum, 1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), sum4);
+}
+#elif defined(__SSSE3__)
+static inline __m128i MulAddInt8(__m128i acc, __m128i x_abs, __m128i w) {
+  __m128i pairs = _mm_maddubs_epi16(x_abs, w);
+  return _mm_add_epi32(acc, _mm_madd_epi16(pairs, _mm_set1_epi16(1)));
+}
+
+// See the AVX2 version above
+static void DotInt8x4(const int8_t* x, const int8_t* w, int stride, int n,
+                      int32_t* out) {
+  __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128(),
+          acc2 = _mm_setzero_si128(), acc3 = _mm_setzero_si128();
+  for (int k = 0; k < n; k += 16) {
+    __m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + k));
+    __m128i x_abs = _mm_abs_epi8(xv);
+    const int8_t* wk = w + k;
+    acc0 = MulAddInt8(acc0, x_abs, _mm_sign_epi8(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(wk)), xv));
+    acc1 = MulAddInt8(acc1, x_abs, _mm_sign_epi8(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(wk + stride)), xv));
+    acc2 = MulAddInt8(acc2, x_abs, _mm_sign_epi8(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(wk + 2 * stride)), xv));
+    acc3 = MulAddInt8(acc3, x_abs, _mm_sign_epi8(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(wk + 3 * stride)), xv));
+  }
+  __m128i sum4 = _mm_hadd_epi32(_mm_hadd_epi32(acc0, acc1),
+                                _mm_hadd_epi32(acc2, acc3));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), sum4);
+}
+#else
+static void DotInt8x4(const int8_t* x, const int8_t* w, int stride, int n,
+                      int32_t* out) {
+  for (int r = 0; r < 4; r++) out[r] = DotInt8(x, w + r * stride, n);
+}
+#endif
+
+void Int8Gemm(const Matrix<int8_t>& x, const Matrix<int8_t>& w,
+              Matrix<int32_t>* out) {
+  CHECK(x.NumCols() == w.NumCols());
+  CHECK(x.NumCols() % kInt8Align == 0);
+  out->Resize(x.NumRows(), w.NumRows());
+  int n = x.NumCols(), num_rows = x.NumRows(), num_cols = w.NumRows();
+  // 4 rows of w against all the rows of x, so the 4 rows stay in L1
+  int j = 0;
+  for (; j + 4 <= num_cols; j += 4) {
+    for (int i = 0; i < num_rows; i++) {
+      DotInt8x4(x.Data() + i * n, w.Data() + j * n, n, n,
+                out->Data() + i * num_cols + j);
+    }
+  }
+  for (; j < num_cols; j++) {
+    for (int i = 0; i < num_rows; i++) {
+      out->Data()[i * num_cols + j] = DotInt8(x.Data() + i * n,
+                                              w.Data() + j * n, n);
+    }
+  }
+}
+
 // @params transpose: if mat2 need transpose
-template <bool transpose>
+// @params pipeline: gemmlowp output stages, from int32 to OType
+template <bool transpose, typename OType, typename Pipeline>
 void IntegerGemm(const Matrix<uint8_t>& mat1, const Matrix<uint8_t>& mat2,
-                 int offset1, int offset2, Matrix<int32_t>* out) {
+                 int offset1, int offset2, const Pipeline& pipeline,
+                 gemmlowp::GemmContext* context, Matrix<OType>* out) {
   CHECK(transpose || (mat1.NumCols() == mat2.NumRows() &&
         out->NumRows() == mat1.NumRows() && out->NumCols() == mat2.NumCols()));
   CHECK(!transpose || (mat1.NumCols() == mat2.NumCols() &&
         out->NumRows() == mat1.NumRows() && out->NumCols() == mat2.NumRows()));
   using gemmlowp::MatrixMap;
-  using gemmlowp::GemmContext;
   using gemmlowp::GemmWithOutputPipeline;
   using gemmlowp::MapOrder;
   using gemmlowp::DefaultL8R8BitDepthParams;
@@ -264,12 +557,39 @@ void IntegerGemm(const Matrix<uint8_t>& mat1, const Matrix<uint8_t>& mat2,
       rhs(mat2.Data(), !transpose ? mat2.NumRows() : mat2.NumCols(),
       !transpose ? mat2.NumCols() : mat2.NumRows(),
       !transpose ? mat2.NumCols() : mat2.NumCols());
-  MatrixMap<int32_t, MapOrder::RowMajor>
+  MatrixMap<OType, MapOrder::RowMajor>
       result(out->Data(), out->NumRows(), out->NumCols(), out->NumCols());
-  const std::tuple<> empty_pipeline = {};
-  GemmContext context;
-  GemmWithOutputPipeline<uint8_t, int32_t, DefaultL8R8BitDepthParams>(&context,
-      lhs, rhs, &result, -offset1, -offset2, empty_pipeline);
+  GemmWithOutputPipeline<uint8_t, OType, DefaultL8R8BitDepthParams>(context,
+      lhs, rhs, &result, -offset1, -offset2, pipeline);
+}
+
+NetWorkspace::~NetWorkspace() {
+  for (size_t i = 0; i < forward_buf_.size(); i++) {
+    delete forward_buf_[i];
+  }
+  for (size_t i = 0; i < quantize_buf_.size(); i++) {
+    delete quantize_buf_[i];
+  }
+  if (gemm_context_ != NULL) delete gemm_context_;
+}
+
+Matrix<uint8_t>* NetWorkspace::QuantizeBuf(size_t i) {
+  while (quantize_buf_.size() <= i) {
+    quantize_buf_.push_back(new Matrix<uint8_t>());
+  }
+  return quantize_buf_[i];
+}
+
+gemmlowp::GemmContext* NetWorkspace::IntegerGemmContext() {
+  if (gemm_context_ == NULL) gemm_context_ = new gemmlowp::GemmContext();
+  return gemm_context_;
+}
+
+Matrix<float>* NetWorkspace::ForwardBuf(size_t i) {
+  while (forward_buf_.size() <= i) {
+    forward_buf_.push_back(new Matrix<float>());
+  }
+  return forward_buf_[i];
 }
 
 std::string LayerTypeToString(LayerType type) {
@@ -280,10 +600,46 @@ std::string LayerTypeToString(LayerType type) {
     case kTanh: return "<Tanh>";
     case kSoftmax: return "<Softmax>";
     case kQuantizeFullyConnect: return "<QuantizeFullyConnect>";
+    case kStaticQuantizeFullyConnect: return "<StaticQuantizeFullyConnect>";
+    case kInt8FullyConnect: return "<Int8FullyConnect>";
     default: return "<Unknown>";
   }
 }
 
+ActivationFunc GetActivationFunc(LayerType type) {
+  switch (type) {
+    case kReLU: return ReLUData;
+    case kSigmoid: return SigmoidData;
+    case kTanh: return TanhData;
+    default: return NULL;
+  }
+}
+
+// data[i] += bias[i]
+static void AddBiasData(const float* bias, int n, float* data) {
+  int i = 0;
+#ifdef __SSE4_1__
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(data + i, _mm_add_ps(_mm_loadu_ps(data + i),
+                                       _mm_loadu_ps(bias + i)));
+  }
+#endif
+  for (; i < n; i++) data[i] += bias[i];
+}
+
+// Epilogue of the fused layers, row by row so the row stays in L1 between
+// the bias and the activation, act may be NULL
+static void AddBiasActivation(const Vector<float>& bias, ActivationFunc act,
+                              Matrix<float>* out) {
+  CHECK(out->NumCols() == bias.Size());
+  int cols = out->NumCols();
+  for (int i = 0; i < out->NumRows(); i++) {
+    float* row = out->Data() + i * cols;
+    AddBiasData(bias.Data(), cols, row);
+    if (act != NULL) act(row, cols, row);
+  }
+}
+
 void Layer::Read(std::istream& is) {
   char t = static_cast<char>(type_);
   is.read(&t, 1);
@@ -300,51 +656,52 @@ void Layer::Write(std::ostream& os) {
   WriteData(os);
 }
 
-void Layer::Forward(const Matrix<float>& in, Matrix<float>* out) {
+void Layer::Forward(const Matrix<float>& in, Matrix<float>* out,
+                    NetWorkspace* workspace) const {
   CHECK(in.NumRows() != 0);
   CHECK(in.NumCols() != 0);
   CHECK(out != NULL);
+  CHECK(workspace != NULL);
   out->Resize(in.NumRows(), out_dim_);
-  ForwardFunc(in, out);
+  ForwardFunc(in, out, workspace);
 }
 
-void Softmax::ForwardFunc(const Matrix<float>& in, Matrix<float>* out) {
-  for (int i = 0; i < in.NumRows(); i++) {
-    float max = in(i, 0), sum = 0.0;
-    for (int j = 1; j < in.NumCols(); j++) {
-      max = std::max(in(i, j), max);
-    }
-    for (int j = 0; j < in.NumCols(); j++) {
-      sum += (*out)(i, j) = exp(in(i, j) - max);
-    }
-    for (int j = 0; j < in.NumCols(); j++) {
-      (*out)(i, j) /= sum;
-    }
-  }
+void Layer::ForwardFused(const Matrix<float>& in, ActivationFunc act,
+                         Matrix<float>* out, NetWorkspace* workspace) const {
+  CHECK(in.NumRows() != 0);
+  CHECK(in.NumCols() != 0);
+  CHECK(out != NULL);
+  CHECK(workspace != NULL);
+  CHECK(CanFuseActivation());
+  out->Resize(in.NumRows(), out_dim_);
+  ForwardFusedFunc(in, act, out, workspace);
 }
 
-void ReLU::ForwardFunc(const Matrix<float>& in, Matrix<float>* out) {
+void Softmax::ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                          NetWorkspace* workspace) const {
+  CHECK(in.NumCols() == out->NumCols());
   for (int i = 0; i < in.NumRows(); i++) {
-    for (int j = 0; j < in.NumCols(); j++) {
-      (*out)(i, j) = std::max(in(i, j), 0.0f);
-    }
+    SoftmaxData(in.Data() + i * in.NumCols(), in.NumCols(),
+                out->Data() + i * out->NumCols());
   }
 }
 
-void Sigmoid::ForwardFunc(const Matrix<float>& in, Matrix<float>* out) {
-  for (int i = 0; i < in.NumRows(); i++) {
-    for (int j = 0; j < in.NumCols(); j++) {
-      (*out)(i, j) = 1.0 / (1 + exp(-in(i, j)));
-    }
-  }
+void ReLU::ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                       NetWorkspace* workspace) const {
+  CHECK(in.Size() == out->Size());
+  ReLUData(in.Data(), in.Size(), out->Data());
 }
 
-void Tanh::ForwardFunc(const Matrix<float>& in, Matrix<float>* out) {
-  for (int i = 0; i < in.NumRows(); i++) {
-    for (int j = 0; j < in.NumCols(); j++) {
-      (*out)(i, j) = tanh(in(i, j));
-    }
-  }
+void Sigmoid::ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                          NetWorkspace* workspace) const {
+  CHECK(in.Size() == out->Size());
+  SigmoidData(in.Data(), in.Size(), out->Data());
+}
+
+void Tanh::ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                       NetWorkspace* workspace) const {
+  CHECK(in.Size() == out->Size());
+  TanhData(in.Data(), in.Size(), out->Data());
 }
 
 void FullyConnect::ReadData(std::istream& is) {
@@ -358,13 +715,40 @@ void FullyConnect::WriteData(std::ostream& os) {
   b_.Write(os);
 }
 
-void FullyConnect::ForwardFunc(const Matrix<float>& in, Matrix<float>* out) {
+void FullyConnect::ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                               NetWorkspace* workspace) const {
+  ForwardFusedFunc(in, NULL, out, workspace);
+}
+
+void FullyConnect::ForwardFusedFunc(const Matrix<float>& in,
+                                    ActivationFunc act, Matrix<float>* out,
+                                    NetWorkspace* workspace) const {
+  // one gemm over all the rows, so w_ is read and packed only once, then
+  // the row by row epilogue
   out->Mul(in, w_, true);
-  out->AddVec(b_);
+  AddBiasActivation(b_, act, out);
 }
 
 Layer* FullyConnect::Quantize() const {
   QuantizeFullyConnect* layer = new QuantizeFullyConnect();
+  QuantizeWeight(layer);
+  return layer;
+}
+
+Layer* FullyConnect::QuantizeWithRange(float in_min, float in_max) const {
+  StaticQuantizeFullyConnect* layer = new StaticQuantizeFullyConnect();
+  QuantizeWeight(layer);
+  layer->SetInputRange(in_min, in_max);
+  return layer;
+}
+
+Layer* FullyConnect::QuantizePerRow() const {
+  Int8FullyConnect* layer = new Int8FullyConnect(in_dim_, out_dim_);
+  layer->QuantizeFrom(w_, b_);
+  return layer;
+}
+
+void FullyConnect::QuantizeWeight(QuantizeFullyConnect* layer) const {
   Matrix<uint8_t> quantize_weight(w_.NumRows(), w_.NumCols());
   float scale = 0;
   uint8_t zero_point = 0;
@@ -376,7 +760,6 @@ Layer* FullyConnect::Quantize() const {
   layer->SetBias(b_);
   layer->SetInputDim(in_dim_);
   layer->SetOutputDim(out_dim_);
-  return layer;
 }
 
 void QuantizeFullyConnect::QuantizeFrom(const Matrix<float>& w,
@@ -403,23 +786,261 @@ void QuantizeFullyConnect::WriteData(std::ostream& os) {
 }
 
 void QuantizeFullyConnect::ForwardFunc(const Matrix<float>& in,
-                                       Matrix<float>* out) {
+                                       Matrix<float>* out,
+                                       NetWorkspace* workspace) const {
+  ForwardFusedFunc(in, NULL, out, workspace);
+}
+
+void QuantizeFullyConnect::ForwardFusedFunc(const Matrix<float>& in,
+                                            ActivationFunc act,
+                                            Matrix<float>* out,
+                                            NetWorkspace* workspace) const {
+  Matrix<uint8_t>* quantize_in = workspace->QuantizeIn();
   // quantize in
   float in_scale;
   uint8_t in_zero_point;
-  quantize_in_.Resize(in.NumRows(), in.NumCols());
+  quantize_in->Resize(in.NumRows(), in.NumCols());
   QuantizeData(in.Data(), in.NumRows() * in.NumCols(), &in_scale,
-               &in_zero_point, quantize_in_.Data());
+               &in_zero_point, quantize_in->Data());
+  ForwardQuantized(*quantize_in, in_scale, in_zero_point, act, out,
+                   workspace);
+}
+
+void QuantizeFullyConnect::ForwardQuantized(const Matrix<uint8_t>& quantize_in,
+                                            float in_scale,
+                                            uint8_t in_zero_point,
+                                            ActivationFunc act,
+                                            Matrix<float>* out,
+                                            NetWorkspace* workspace) const {
+  Matrix<int32_t>* quantize_out = workspace->QuantizeOut();
   //// uint8 gemm
-  quantize_out_.Resize(out->NumRows(), out->NumCols());
-  IntegerGemm<true>(quantize_in_, w_, static_cast<int>(in_zero_point),
-                    static_cast<int>(w_zero_point_), &quantize_out_);
-  //// dequantize
+  quantize_out->Resize(out->NumRows(), out->NumCols());
+  const std::tuple<> empty_pipeline = {};
+  IntegerGemm<true>(quantize_in, w_, static_cast<int>(in_zero_point),
+                    static_cast<int>(w_zero_point_), empty_pipeline,
+                    workspace->IntegerGemmContext(), quantize_out);
+  //// dequantize, add bias and activation, row by row
   float out_scale = in_scale * w_scale_;
-  DequantizeData(quantize_out_.Data(), out->NumRows() * out->NumCols(),
-                 out_scale, 0, out->Data());
-  //// add bias
-  out->AddVec(b_);
+  int cols = out->NumCols();
+  for (int i = 0; i < out->NumRows(); i++) {
+    float* row = out->Data() + i * cols;
+    DequantizeData(quantize_out->Data() + i * cols, cols, out_scale, 0, row);
+    AddBiasData(b_.Data(), cols, row);
+    if (act != NULL) act(row, cols, row);
+  }
+}
+
+void StaticQuantizeFullyConnect::SetInputRange(float min, float max) {
+  // The bias is quantized to int32 by in_scale_ * w_scale_, widen a range
+  // too narrow for it, eg. of a dead relu output, the inputs in the range
+  // are still quantized exactly enough then
+  float max_abs_b = 0.0f;
+  for (int i = 0; i < b_.Size(); i++) {
+    max_abs_b = std::max(max_abs_b, fabsf(b_(i)));
+  }
+  float min_range = 255 * max_abs_b / (w_scale_ * (1 << 30));
+  min = std::min(min, 0.f);
+  max = std::max(max, 0.f);
+  if (max - min < min_range) max = min + min_range;
+  ChooseQuantizationParams(min, max, &in_scale_, &in_zero_point_);
+  QuantizeBias();
+}
+
+void StaticQuantizeFullyConnect::QuantizeBias() {
+  CHECK(in_scale_ > 0 && w_scale_ > 0);
+  double scale = static_cast<double>(in_scale_) * w_scale_;
+  quantize_b_.Resize(b_.Size());
+  for (int i = 0; i < b_.Size(); i++) {
+    double b = round(b_(i) / scale);
+    CHECK(fabs(b) < 2147483647.0);
+    quantize_b_(i) = static_cast<int32_t>(b);
+  }
+}
+
+void StaticQuantizeFullyConnect::ReadData(std::istream& is) {
+  QuantizeFullyConnect::ReadData(is);
+  is.read(reinterpret_cast<char *>(&in_scale_), sizeof(float));
+  is.read(reinterpret_cast<char *>(&in_zero_point_), sizeof(uint8_t));
+  CHECK(in_scale_ > 0);
+  QuantizeBias();
+}
+
+void StaticQuantizeFullyConnect::WriteData(std::ostream& os) {
+  QuantizeFullyConnect::WriteData(os);
+  os.write(reinterpret_cast<char *>(&in_scale_), sizeof(float));
+  os.write(reinterpret_cast<char *>(&in_zero_point_), sizeof(uint8_t));
+}
+
+void StaticQuantizeFullyConnect::ForwardFusedFunc(const Matrix<float>& in,
+    ActivationFunc act, Matrix<float>* out, NetWorkspace* workspace) const {
+  Matrix<uint8_t>* quantize_in = workspace->QuantizeIn();
+  QuantizeInput(in, quantize_in);
+  ForwardQuantized(*quantize_in, in_scale_, in_zero_point_, act, out,
+                   workspace);
+}
+
+// The requantization multiplier of the int32 gemm output to the input of
+// next, as gemmlowp's fixed point multiplier * 2^-shift, multiplier in
+// [2^30, 2^31). Returns false if it is not in (0, 1).
+static bool RequantizeMultiplier(double multiplier, int32_t* fixed_point,
+                                 int32_t* shift) {
+  if (!(multiplier > 0.0 && multiplier < 1.0)) return false;
+  *shift = 0;
+  while (multiplier < 0.5) {
+    multiplier *= 2.0;
+    (*shift)++;
+  }
+  int64_t q = static_cast<int64_t>(round(multiplier * (1ll << 31)));
+  if (q == (1ll << 31)) {
+    q /= 2;
+    (*shift)--;
+  }
+  *fixed_point = static_cast<int32_t>(q);
+  return *shift >= 0;
+}
+
+bool StaticQuantizeFullyConnect::CanRequantize(
+    const StaticQuantizeFullyConnect& next) const {
+  double multiplier = static_cast<double>(in_scale_) * w_scale_ /
+                      next.in_scale_;
+  int32_t fixed_point, shift;
+  return out_dim_ == next.InDim() &&
+         RequantizeMultiplier(multiplier, &fixed_point, &shift);
+}
+
+void StaticQuantizeFullyConnect::QuantizeInput(const Matrix<float>& in,
+    Matrix<uint8_t>* quantize_in) const {
+  quantize_in->Resize(in.NumRows(), in.NumCols());
+  QuantizeData(in.Data(), in.Size(), in_scale_, in_zero_point_,
+               quantize_in->Data());
+}
+
+void StaticQuantizeFullyConnect::ForwardRequantize(
+    const Matrix<uint8_t>& quantize_in, bool relu,
+    const StaticQuantizeFullyConnect& next, Matrix<uint8_t>* quantize_out,
+    NetWorkspace* workspace) const {
+  CHECK(quantize_in.NumCols() == in_dim_);
+  quantize_out->Resize(quantize_in.NumRows(), out_dim_);
+  gemmlowp::OutputStageBiasAddition<
+      gemmlowp::VectorMap<const int32_t, gemmlowp::VectorShape::Row> >
+      bias_stage;
+  bias_stage.bias_vector = gemmlowp::VectorMap<const int32_t,
+      gemmlowp::VectorShape::Row>(quantize_b_.Data(), quantize_b_.Size());
+  gemmlowp::OutputStageQuantizeDownInt32ToUint8ScaleByFixedPoint
+      requantize_stage;
+  double multiplier = static_cast<double>(in_scale_) * w_scale_ /
+                      next.in_scale_;
+  CHECK(RequantizeMultiplier(multiplier,
+                             &requantize_stage.result_fixedpoint_multiplier,
+                             &requantize_stage.result_shift));
+  requantize_stage.result_offset_after_shift = next.in_zero_point_;
+  // relu(x) >= 0, which is next.in_zero_point_ after requantization
+  gemmlowp::OutputStageClamp clamp_stage;
+  clamp_stage.min = relu ? next.in_zero_point_ : 0;
+  clamp_stage.max = 255;
+  gemmlowp::OutputStageSaturatingCastToUint8 cast_stage;
+  IntegerGemm<true>(quantize_in, w_, static_cast<int>(in_zero_point_),
+                    static_cast<int>(w_zero_point_),
+                    std::make_tuple(bias_stage, requantize_stage,
+                                    clamp_stage, cast_stage),
+                    workspace->IntegerGemmContext(), quantize_out);
+}
+
+void StaticQuantizeFullyConnect::ForwardQuantizedInput(
+    const Matrix<uint8_t>& quantize_in, ActivationFunc act,
+    Matrix<float>* out, NetWorkspace* workspace) const {
+  CHECK(quantize_in.NumCols() == in_dim_);
+  out->Resize(quantize_in.NumRows(), out_dim_);
+  ForwardQuantized(quantize_in, in_scale_, in_zero_point_, act, out,
+                   workspace);
+}
+
+void Int8FullyConnect::QuantizeFrom(const Matrix<float>& w,
+                                    const Vector<float>& b) {
+  CHECK(w.NumRows() == b.Size());
+  int cols = (w.NumCols() + kInt8Align - 1) / kInt8Align * kInt8Align;
+  w_.Resize(w.NumRows(), cols);
+  memset(w_.Data(), 0, w_.Size() * sizeof(int8_t));
+  w_scale_.Resize(w.NumRows());
+  for (int i = 0; i < w.NumRows(); i++) {
+    QuantizeSymmetricData(w.Data() + i * w.NumCols(), w.NumCols(),
+                          w_scale_.Data() + i, w_.Data() + i * cols);
+  }
+  b_.CopyFrom(b);
+  ComputeWeightSum();
+}
+
+void Int8FullyConnect::ComputeWeightSum() {
+  w_sum_.Resize(w_.NumRows());
+  for (int i = 0; i < w_.NumRows(); i++) {
+    int32_t sum = 0;
+    for (int j = 0; j < w_.NumCols(); j++) sum += w_(i, j);
+    w_sum_(i) = sum;
+  }
+}
+
+void Int8FullyConnect::ReadData(std::istream& is) {
+  w_.Read(is);
+  w_scale_.Read(is);
+  b_.Read(is);
+  CHECK(w_.NumCols() % kInt8Align == 0);
+  // w_ is in_dim_ padded to kInt8Align
+  CHECK(in_dim_ <= w_.NumCols());
+  CHECK(out_dim_ == w_.NumRows());
+  CHECK(w_.NumRows() == w_scale_.Size());
+  CHECK(w_.NumRows() == b_.Size());
+  ComputeWeightSum();
+}
+
+void Int8FullyConnect::WriteData(std::ostream& os) {
+  w_.Write(os);
+  w_scale_.Write(os);
+  b_.Write(os);
+}
+
+void Int8FullyConnect::ForwardFunc(const Matrix<float>& in,
+                                   Matrix<float>* out,
+                                   NetWorkspace* workspace) const {
+  ForwardFusedFunc(in, NULL, out, workspace);
+}
+
+void Int8FullyConnect::ForwardFusedFunc(const Matrix<float>& in,
+                                        ActivationFunc act,
+                                        Matrix<float>* out,
+                                        NetWorkspace* workspace) const {
+  // The rows of x are w_.NumCols() wide, no room for a wider input
+  CHECK(in.NumCols() == in_dim_);
+  Matrix<int8_t>* x = workspace->Int8In();
+  Vector<float>* x_scale = workspace->Int8InScale();
+  Vector<int32_t>* x_zero_point = workspace->Int8InZeroPoint();
+  Matrix<int32_t>* acc = workspace->QuantizeOut();
+  int cols = w_.NumCols();
+  // quantize in, frame by frame
+  x->Resize(in.NumRows(), cols);
+  x_scale->Resize(in.NumRows());
+  x_zero_point->Resize(in.NumRows());
+  memset(x->Data(), 0, x->Size() * sizeof(int8_t));
+  for (int i = 0; i < in.NumRows(); i++) {
+    QuantizeInt8Data(in.Data() + i * in.NumCols(), in.NumCols(),
+                     x_scale->Data() + i, x_zero_point->Data() + i,
+                     x->Data() + i * cols);
+  }
+  //// int8 gemm
+  Int8Gemm(*x, w_, acc);
+  //// dequantize, add bias and activation, row by row
+  int out_cols = out->NumCols();
+  for (int i = 0; i < out->NumRows(); i++) {
+    const int32_t* acc_row = acc->Data() + i * out_cols;
+    float* row = out->Data() + i * out_cols;
+    float scale = (*x_scale)(i);
+    int64_t zero_point = (*x_zero_point)(i);
+    for (int j = 0; j < out_cols; j++) {
+      // in int64, zero_point * w_sum may not fit in int32
+      int64_t sum = acc_row[j] - zero_point * w_sum_.Data()[j];
+      row[j] = sum * scale * w_scale_.Data()[j] + b_.Data()[j];
+    }
+    if (act != NULL) act(row, out_cols, row);
+  }
 }
 
 Net::~Net() {
@@ -430,9 +1051,7 @@ void Net::Clear() {
   for (size_t i = 0; i < layers_.size(); i++) {
     delete layers_[i];
   }
-  for (size_t i = 0; i < forward_buf_.size(); i++) {
-    delete forward_buf_[i];
-  }
+  layers_.clear();
 }
 
 void Net::Read(const std::string& filename) {
@@ -464,6 +1083,12 @@ void Net::Read(const std::string& filename) {
       case kQuantizeFullyConnect:
         layer = new QuantizeFullyConnect();
         break;
+      case kStaticQuantizeFullyConnect:
+        layer = new StaticQuantizeFullyConnect();
+        break;
+      case kInt8FullyConnect:
+        layer = new Int8FullyConnect();
+        break;
       default:
         ERROR("Unknown layer type %d", t);
     }
@@ -483,23 +1108,63 @@ void Net::Write(const std::string& filename) {
   }
 }
 
-void Net::Forward(const Matrix<float>& in, Matrix<float> *out) {
+void Net::Forward(const Matrix<float>& in, Matrix<float> *out,
+                  NetWorkspace* workspace) const {
   CHECK(out != NULL);
+  CHECK(workspace != NULL);
   CHECK(layers_.size() > 0);
   size_t num_layers = layers_.size();
-  if (forward_buf_.size() != num_layers) {
-    for (size_t i = 0; i < num_layers - 1; i++) {
-      forward_buf_.push_back(new Matrix<float>());
+  const Matrix<float>* layer_in = &in;
+  // Set if the input of the layer is already quantized by the integer
+  // pipeline: StaticQuantizeFullyConnect [ReLU] StaticQuantizeFullyConnect
+  // are forwarded in uint8 all along, only the last one outputs float
+  const Matrix<uint8_t>* quantize_in = NULL;
+  for (size_t i = 0; i < num_layers; ) {
+    if (layers_[i]->Type() == kStaticQuantizeFullyConnect) {
+      const StaticQuantizeFullyConnect* layer =
+          static_cast<const StaticQuantizeFullyConnect*>(layers_[i]);
+      bool relu = i + 1 < num_layers && layers_[i + 1]->Type() == kReLU;
+      size_t next = relu ? i + 2 : i + 1;
+      if (next < num_layers &&
+          layers_[next]->Type() == kStaticQuantizeFullyConnect) {
+        const StaticQuantizeFullyConnect* next_layer =
+            static_cast<const StaticQuantizeFullyConnect*>(layers_[next]);
+        if (layer->CanRequantize(*next_layer)) {
+          if (quantize_in == NULL) {
+            Matrix<uint8_t>* buf = workspace->QuantizeBuf(i);
+            layer->QuantizeInput(*layer_in, buf);
+            quantize_in = buf;
+          }
+          Matrix<uint8_t>* quantize_out = workspace->QuantizeBuf(next);
+          layer->ForwardRequantize(*quantize_in, relu, *next_layer,
+                                   quantize_out, workspace);
+          quantize_in = quantize_out;
+          i = next;
+          continue;
+        }
+      }
     }
-  }
-  if (layers_.size() == 1) {
-    layers_[0]->Forward(in, out);
-  } else {
-    layers_[0]->Forward(in, forward_buf_[0]);
-    for (size_t i = 1; i < layers_.size() - 1; i++) {
-      layers_[i]->Forward(*(forward_buf_[i-1]), forward_buf_[i]);
+    // fuse the activation after it, if any
+    ActivationFunc act = NULL;
+    if (i + 1 < num_layers && layers_[i]->CanFuseActivation()) {
+      act = GetActivationFunc(layers_[i + 1]->Type());
     }
-    layers_[num_layers-1]->Forward(*(forward_buf_[num_layers-2]), out);
+    size_t next = act != NULL ? i + 2 : i + 1;
+    Matrix<float>* layer_out = next == num_layers ? out :
+                               workspace->ForwardBuf(i);
+    if (quantize_in != NULL) {
+      // the end of the integer pipeline
+      CHECK(layers_[i]->Type() == kStaticQuantizeFullyConnect);
+      static_cast<const StaticQuantizeFullyConnect*>(layers_[i])->
+          ForwardQuantizedInput(*quantize_in, act, layer_out, workspace);
+      quantize_in = NULL;
+    } else if (act != NULL) {
+      layers_[i]->ForwardFused(*layer_in, act, layer_out, workspace);
+    } else {
+      layers_[i]->Forward(*layer_in, layer_out, workspace);
+    }
+    layer_in = layer_out;
+    i = next;
   }
 }
 
@@ -516,9 +1181,53 @@ void Net::Quantize(Net* quantize_net) const {
   }
 }
 
+void Net::QuantizePerRow(Net* quantize_net) const {
+  quantize_net->Clear();
+  for (size_t i = 0; i < layers_.size(); i++) {
+    quantize_net->AddLayer(layers_[i]->QuantizePerRow());
+  }
+}
+
+void Net::UpdateInputRange(const Matrix<float>& in, NetWorkspace* workspace,
+                           std::vector<float>* in_min,
+                           std::vector<float>* in_max) const {
+  CHECK(workspace != NULL);
+  if (in_min->empty()) {
+    in_min->assign(layers_.size(), std::numeric_limits<float>::max());
+    in_max->assign(layers_.size(), -std::numeric_limits<float>::max());
+  }
+  CHECK(in_min->size() == layers_.size());
+  CHECK(in_max->size() == layers_.size());
+  // layer by layer without fusion, every layer input is needed
+  const Matrix<float>* layer_in = &in;
+  for (size_t i = 0; i < layers_.size(); i++) {
+    float min, max;
+    FindMinMax(layer_in->Data(), layer_in->Size(), &min, &max);
+    (*in_min)[i] = std::min((*in_min)[i], min);
+    (*in_max)[i] = std::max((*in_max)[i], max);
+    Matrix<float>* layer_out = workspace->ForwardBuf(i);
+    layers_[i]->Forward(*layer_in, layer_out, workspace);
+    layer_in = layer_out;
+  }
+}
+
+void Net::Quantize(const std::vector<float>& in_min,
+                   const std::vector<float>& in_max,
+                   Net* quantize_net) const {
+  CHECK(in_min.size() == layers_.size());
+  CHECK(in_max.size() == layers_.size());
+  quantize_net->Clear();
+  for (size_t i = 0; i < layers_.size(); i++) {
+    quantize_net->AddLayer(layers_[i]->QuantizeWithRange(in_min[i],
+                                                         in_max[i]));
+  }
+}
+
+template class Matrix<int8_t>;
 template class Matrix<uint8_t>;
 template class Matrix<int>;
 template class Matrix<float>;
+template class Vector<int8_t>;
 template class Vector<uint8_t>;
 template class Vector<int>;
 template class Vector<float>;
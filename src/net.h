@@ -28,6 +28,10 @@
 
 #include "utils.h"
 
+namespace gemmlowp {
+class GemmContext;
+}  // namespace gemmlowp
+
 namespace xdecoder {
 
 /* Matrix & Vector Defination */
@@ -36,7 +40,8 @@ class Tensor {
  public:
   explicit Tensor(DType* data = nullptr): data_(data), shape_(Dim, 0),
                                           holder_(false) {}
-  explicit Tensor(const Tensor<DType, Dim>& tensor) {
+  explicit Tensor(const Tensor<DType, Dim>& tensor): data_(nullptr),
+      shape_(Dim, 0), holder_(false) {
     CopyFrom(tensor);
   }
   virtual ~Tensor() {
@@ -135,6 +140,33 @@ void ChooseQuantizationParams(float min, float max, float* scale,
                               uint8_t* zero_point);
 void QuantizeData(const float* src, int n, float scale, uint8_t zero_point,
                   uint8_t* dest);
+// Symmetric int8 quantization, dest in [-127, 127] and scale is
+// max(|src|) / 127, there is no zero point
+void QuantizeSymmetricData(const float* src, int n, float* scale,
+                           int8_t* dest);
+// int8 quantization of [min, max] to [-127, 127], src = scale * (dest -
+// zero_point), for the input of the int8 layers, which is often all positive
+void QuantizeInt8Data(const float* src, int n, float* scale,
+                      int32_t* zero_point, int8_t* dest);
+
+// The rows of the int8 matrices of Int8Gemm are padded to it with 0
+const int kInt8Align = 32;
+// out(i, j) = dot(row i of x, row j of w), both int8 in [-127, 127], so
+// pmaddubsw never saturates. It uses SSSE3 pmaddubsw/pmaddwd, or AVX2 and
+// VNNI vpdpbusd when the build enables them.
+void Int8Gemm(const Matrix<int8_t>& x, const Matrix<int8_t>& w,
+              Matrix<int32_t>* out);
+
+/* Activation Functions */
+
+// Over n contiguous floats, src and dest may be the same. They use SSE4.1
+// and a polynomial exp when it is enabled, the error is within 1e-6 of the
+// exp()/tanh() of libm, see net-test.
+void ReLUData(const float* src, int n, float* dest);
+void SigmoidData(const float* src, int n, float* dest);
+void TanhData(const float* src, int n, float* dest);
+// Softmax of one row of n values
+void SoftmaxData(const float* src, int n, float* dest);
 
 /* Layer Defination */
 typedef enum {
@@ -144,11 +176,52 @@ typedef enum {
   kTanh,
   kSoftmax,
   kQuantizeFullyConnect,
+  kStaticQuantizeFullyConnect,
+  kInt8FullyConnect,
   kUnknown
 } LayerType;
 
 std::string LayerTypeToString(LayerType type);
 
+// The elementwise activation of type, NULL if type is not an activation
+typedef void (*ActivationFunc)(const float* src, int n, float* dest);
+ActivationFunc GetActivationFunc(LayerType type);
+
+// All the intermediate results of Net::Forward. Net and Layer are immutable
+// after loading, so one Net can be shared by many threads, as long as every
+// thread forwards it with its own NetWorkspace.
+class NetWorkspace {
+ public:
+  NetWorkspace(): gemm_context_(NULL) {}
+  ~NetWorkspace();
+  // Output buffer of the i-th layer, allocated on demand
+  Matrix<float>* ForwardBuf(size_t i);
+  Matrix<uint8_t>* QuantizeIn() { return &quantize_in_; }
+  // Quantized input of the i-th layer in the integer pipeline, see
+  // Net::Forward, allocated on demand
+  Matrix<uint8_t>* QuantizeBuf(size_t i);
+  // int8 input of Int8FullyConnect, and the scale and the zero point of
+  // every row of it
+  Matrix<int8_t>* Int8In() { return &int8_in_; }
+  Vector<float>* Int8InScale() { return &int8_in_scale_; }
+  Vector<int32_t>* Int8InZeroPoint() { return &int8_in_zero_point_; }
+  Matrix<int32_t>* QuantizeOut() { return &quantize_out_; }
+  // gemmlowp context of the uint8 gemm, created on demand and kept for the
+  // life of the workspace, so its packing buffers are allocated only once
+  gemmlowp::GemmContext* IntegerGemmContext();
+
+ private:
+  std::vector<Matrix<float>*> forward_buf_;
+  std::vector<Matrix<uint8_t>*> quantize_buf_;
+  Matrix<uint8_t> quantize_in_;
+  Matrix<int32_t> quantize_out_;
+  Matrix<int8_t> int8_in_;
+  Vector<float> int8_in_scale_;
+  Vector<int32_t> int8_in_zero_point_;
+  gemmlowp::GemmContext* gemm_context_;
+  DISALLOW_COPY_AND_ASSIGN(NetWorkspace);
+};
+
 class Layer {
  public:
   explicit Layer(int32_t in_dim = 0, int32_t out_dim = 0,
@@ -157,7 +230,13 @@ class Layer {
   virtual ~Layer() {}
   void Read(std::istream& is);
   void Write(std::ostream& os);
-  void Forward(const Matrix<float>& in, Matrix<float>* out);
+  void Forward(const Matrix<float>& in, Matrix<float>* out,
+               NetWorkspace* workspace) const;
+  // Forward and apply act to the output in the row by row epilogue of this
+  // layer, only for layers which CanFuseActivation()
+  void ForwardFused(const Matrix<float>& in, ActivationFunc act,
+                    Matrix<float>* out, NetWorkspace* workspace) const;
+  virtual bool CanFuseActivation() const { return false; }
   int32_t InDim() const { return in_dim_; }
   int32_t OutDim() const { return out_dim_; }
   void SetInputDim(int32_t in_dim) { in_dim_ = in_dim; }
@@ -171,9 +250,24 @@ class Layer {
   virtual Layer* Quantize() const {
     return this->Copy();
   }
+  // Quantize with the input range [in_min, in_max] found by calibration, so
+  // the input is quantized by fixed params instead of its own min and max
+  virtual Layer* QuantizeWithRange(float in_min, float in_max) const {
+    return this->Quantize();
+  }
+  // Quantize to int8 with a scale per output row, see Int8FullyConnect
+  virtual Layer* QuantizePerRow() const {
+    return this->Copy();
+  }
 
  protected:
-  virtual void ForwardFunc(const Matrix<float>& in, Matrix<float>* out) = 0;
+  virtual void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                           NetWorkspace* workspace) const = 0;
+  virtual void ForwardFusedFunc(const Matrix<float>& in, ActivationFunc act,
+                                Matrix<float>* out,
+                                NetWorkspace* workspace) const {
+    ERROR("%s can not be fused", LayerTypeToString(type_).c_str());
+  }
   virtual void ReadData(std::istream& is) {}
   virtual void WriteData(std::ostream& os) {}
   int32_t in_dim_, out_dim_;
@@ -187,7 +281,8 @@ class ReLU: public Layer {
   Layer* Copy() const { return new ReLU(*this); }
 
  private:
-  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out);
+  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                   NetWorkspace* workspace) const;
 };
 
 class Sigmoid: public Layer {
@@ -197,7 +292,8 @@ class Sigmoid: public Layer {
   Layer* Copy() const { return new Sigmoid(*this); }
 
  private:
-  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out);
+  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                   NetWorkspace* workspace) const;
 };
 
 class Tanh: public Layer {
@@ -207,7 +303,8 @@ class Tanh: public Layer {
   Layer* Copy() const { return new Tanh(*this); }
 
  private:
-  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out);
+  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                   NetWorkspace* workspace) const;
 };
 
 class Softmax: public Layer {
@@ -217,9 +314,12 @@ class Softmax: public Layer {
   Layer* Copy() const { return new Softmax(*this); }
 
  private:
-  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out);
+  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                   NetWorkspace* workspace) const;
 };
 
+class QuantizeFullyConnect;
+
 class FullyConnect : public Layer {
  public:
   explicit FullyConnect(int32_t in_dim = 0, int32_t out_dim = 0):
@@ -228,37 +328,119 @@ class FullyConnect : public Layer {
   const Vector<float>& B() { return b_; }
   Layer* Copy() const { return new FullyConnect(*this); }
   virtual Layer* Quantize() const;
+  virtual Layer* QuantizeWithRange(float in_min, float in_max) const;
+  virtual Layer* QuantizePerRow() const;
+  bool CanFuseActivation() const { return true; }
 
  private:
+  void QuantizeWeight(QuantizeFullyConnect* layer) const;
   void ReadData(std::istream& is);
   void WriteData(std::ostream& os);
-  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out);
+  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                   NetWorkspace* workspace) const;
+  void ForwardFusedFunc(const Matrix<float>& in, ActivationFunc act,
+                        Matrix<float>* out, NetWorkspace* workspace) const;
   Matrix<float> w_;  // w_ is cols major, so it's size (out_dim, in_dim)
   Vector<float> b_;  // size(out_dim)
 };
 
+// Quantizes every input by its min and max
 class QuantizeFullyConnect : public Layer {
  public:
-  explicit QuantizeFullyConnect(int32_t in_dim = 0, int32_t out_dim = 0):
-      Layer(in_dim, out_dim, kQuantizeFullyConnect) {}
+  explicit QuantizeFullyConnect(int32_t in_dim = 0, int32_t out_dim = 0,
+                                LayerType type = kQuantizeFullyConnect):
+      Layer(in_dim, out_dim, type) {}
   void QuantizeFrom(const Matrix<float>& w, const Vector<float>& b);
   Layer* Copy() const { return new QuantizeFullyConnect(*this); }
   void SetWeight(const Matrix<uint8_t>& weight) { w_.CopyFrom(weight); }
   void SetBias(const Vector<float>& bias) { b_.CopyFrom(bias); }
   void SetWeightScale(float scale) { w_scale_ = scale; }
   void SetWeightZeroPoint(uint8_t zero_point) { w_zero_point_ = zero_point; }
+  bool CanFuseActivation() const { return true; }
 
- private:
+ protected:
   void ReadData(std::istream& is);
   void WriteData(std::ostream& os);
-  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out);
+  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                   NetWorkspace* workspace) const;
+  void ForwardFusedFunc(const Matrix<float>& in, ActivationFunc act,
+                        Matrix<float>* out, NetWorkspace* workspace) const;
+  // uint8 gemm of the quantized input, then dequantize, bias and act
+  void ForwardQuantized(const Matrix<uint8_t>& quantize_in, float in_scale,
+                        uint8_t in_zero_point, ActivationFunc act,
+                        Matrix<float>* out, NetWorkspace* workspace) const;
   Matrix<uint8_t> w_;  // w_ is cols major, so it's size (out_dim, in_dim)
   float w_scale_;
   uint8_t w_zero_point_;
 
   Vector<float> b_;  // use float bias
-  Matrix<int32_t> quantize_out_;
-  Matrix<uint8_t> quantize_in_;
+};
+
+// Quantizes the input by the fixed params from calibration, see
+// net-quantization, so the result of a frame doesn't depend on the batch
+class StaticQuantizeFullyConnect : public QuantizeFullyConnect {
+ public:
+  explicit StaticQuantizeFullyConnect(int32_t in_dim = 0,
+                                      int32_t out_dim = 0):
+      QuantizeFullyConnect(in_dim, out_dim, kStaticQuantizeFullyConnect),
+      in_scale_(1.0f), in_zero_point_(0) {}
+  Layer* Copy() const { return new StaticQuantizeFullyConnect(*this); }
+  void SetInputRange(float min, float max);
+
+  // The integer pipeline of Net::Forward, where the output of this layer,
+  // after an optional ReLU, is the quantized input of next. The bias, the
+  // requantization to the params of next and the ReLU clamp are the output
+  // stages of the uint8 gemm, so nothing is dequantized in between.
+  // Returns false if the scales can't be requantized in fixed point.
+  bool CanRequantize(const StaticQuantizeFullyConnect& next) const;
+  void QuantizeInput(const Matrix<float>& in,
+                     Matrix<uint8_t>* quantize_in) const;
+  void ForwardRequantize(const Matrix<uint8_t>& quantize_in, bool relu,
+                         const StaticQuantizeFullyConnect& next,
+                         Matrix<uint8_t>* quantize_out,
+                         NetWorkspace* workspace) const;
+  // The last layer of the integer pipeline, which outputs float again
+  void ForwardQuantizedInput(const Matrix<uint8_t>& quantize_in,
+                             ActivationFunc act, Matrix<float>* out,
+                             NetWorkspace* workspace) const;
+
+ private:
+  void ReadData(std::istream& is);
+  void WriteData(std::ostream& os);
+  void ForwardFusedFunc(const Matrix<float>& in, ActivationFunc act,
+                        Matrix<float>* out, NetWorkspace* workspace) const;
+  // Bias in the scale of the int32 gemm output, in_scale_ * w_scale_
+  void QuantizeBias();
+  float in_scale_;
+  uint8_t in_zero_point_;
+  Vector<int32_t> quantize_b_;
+};
+
+// Symmetric int8 weights with a scale per output row, so a row with
+// outliers doesn't cost the precision of the others. The input is
+// quantized to int8 frame by frame, by its own min and max.
+class Int8FullyConnect : public Layer {
+ public:
+  explicit Int8FullyConnect(int32_t in_dim = 0, int32_t out_dim = 0):
+      Layer(in_dim, out_dim, kInt8FullyConnect) {}
+  void QuantizeFrom(const Matrix<float>& w, const Vector<float>& b);
+  Layer* Copy() const { return new Int8FullyConnect(*this); }
+  bool CanFuseActivation() const { return true; }
+
+ private:
+  void ReadData(std::istream& is);
+  void WriteData(std::ostream& os);
+  void ForwardFunc(const Matrix<float>& in, Matrix<float>* out,
+                   NetWorkspace* workspace) const;
+  void ForwardFusedFunc(const Matrix<float>& in, ActivationFunc act,
+                        Matrix<float>* out, NetWorkspace* workspace) const;
+  void ComputeWeightSum();
+  // size (out_dim, in_dim rounded up to kInt8Align), the padding is 0
+  Matrix<int8_t> w_;
+  Vector<float> w_scale_;  // size(out_dim)
+  // sum of every row of w_, for the zero point of the input
+  Vector<int32_t> w_sum_;
+  Vector<float> b_;  // size(out_dim)
 };
 
 
@@ -282,14 +464,36 @@ class Net {
     return layers_[layers_.size() - 1]->OutDim();
   }
 
-  void Forward(const Matrix<float>& in, Matrix<float>* out);
+  // Forward with the net's own workspace, only for single thread usage
+  void Forward(const Matrix<float>& in, Matrix<float>* out) {
+    Forward(in, out, &workspace_);
+  }
+  // Thread safe as long as every thread uses its own workspace. A layer with
+  // a gemm and the activation layer after it are run as one fused layer.
+  void Forward(const Matrix<float>& in, Matrix<float>* out,
+               NetWorkspace* workspace) const;
   void Info() const;
   void AddLayer(Layer* layer) {
     layers_.push_back(layer);
   }
+  int32_t NumLayers() const { return layers_.size(); }
+  const Layer* GetLayer(int32_t i) const {
+    CHECK(i >= 0 && i < NumLayers());
+    return layers_[i];
+  }
 
   // For Quantization
   void Quantize(Net* quantize_net) const;
+  // Updates the min and max of the input of every layer by in, they are
+  // resized to the number of layers on the first call
+  void UpdateInputRange(const Matrix<float>& in, NetWorkspace* workspace,
+                        std::vector<float>* in_min,
+                        std::vector<float>* in_max) const;
+  // Quantize with the input ranges of UpdateInputRange
+  void Quantize(const std::vector<float>& in_min,
+                const std::vector<float>& in_max, Net* quantize_net) const;
+  // Quantize to int8 per output row, see Int8FullyConnect
+  void QuantizePerRow(Net* quantize_net) const;
   // For xdecoder
   bool IsLastLayerSoftmax() const {
     CHECK(layers_.size() > 0);
@@ -298,7 +502,7 @@ class Net {
 
  protected:
   std::vector<Layer*> layers_;
-  std::vector<Matrix<float>*> forward_buf_;
+  NetWorkspace workspace_;
 };
 
 }  // namespace xdecoder
@@ -21,8 +21,10 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "utils.h"
+#include "huge-page.h"
 
 namespace xdecoder {
 
@@ -154,6 +156,105 @@ class CacheObjectPool : public IObjectPool<Type> {
   Node* first_node_, *last_node_;  // link list head and tail
 };
 
+// IndexedObjectPool hands out 32 bit indices instead of pointers, so that
+// objects linked to each other (eg. decoder tokens) can store half-size
+// links. Objects live in fixed size blocks of (1 << BlockBits) objects, an
+// index is resolved with a shift and a mask, and objects never move when
+// the pool grows.
+template <class Type, int32_t BlockBits = 12>
+class IndexedObjectPool {
+ public:
+  static const uint32_t kNullIndex = 0xffffffff;
+
+  IndexedObjectPool(): size_(0), free_(0), latest_deleted_(kNullIndex),
+                       use_huge_pages_(UseHugePages()) {
+    // The free list is stored in the first 4 bytes of the deleted objects
+    CHECK(sizeof(Type) >= sizeof(uint32_t));
+  }
+
+  ~IndexedObjectPool() {
+    for (size_t i = 0; i < blocks_.size(); i++) {
+      if (use_huge_pages_) {
+        for (size_t j = 0; j < kBlockSize; j++) blocks_[i][j].~Type();
+      } else {
+        delete [] blocks_[i];
+      }
+    }
+    for (size_t i = 0; i < chunks_.size(); i++) {
+      HugePageFree(chunks_[i], kChunkSize);
+    }
+  }
+
+  inline uint32_t New() {
+    uint32_t index;
+    if (latest_deleted_ != kNullIndex) {
+      index = latest_deleted_;
+      latest_deleted_ = *(reinterpret_cast<uint32_t *>(Get(index)));
+      free_--;
+    } else {
+      if ((size_ >> BlockBits) >= blocks_.size()) {
+        blocks_.push_back(NewBlock());
+      }
+      index = size_++;
+      CHECK(index != kNullIndex);
+    }
+    return index;
+  }
+
+  inline void Delete(uint32_t index) {
+    *(reinterpret_cast<uint32_t *>(Get(index))) = latest_deleted_;
+    latest_deleted_ = index;
+    free_++;
+  }
+
+  inline Type* Get(uint32_t index) const {
+    return blocks_[index >> BlockBits] + (index & ((1 << BlockBits) - 1));
+  }
+
+  std::string Report() {
+    std::stringstream ss;
+    ss << "allocated " << blocks_.size() * (1 << BlockBits)
+       << " free " << free_ << " cursor " << size_;
+    if (use_huge_pages_) {
+      size_t huge_bytes = 0;
+      for (size_t i = 0; i < chunks_.size(); i++) {
+        huge_bytes += HugePageBytes(chunks_[i], kChunkSize);
+      }
+      ss << " chunks " << chunks_.size() * kChunkSize / 1048576.0
+         << "MB huge pages " << huge_bytes / 1048576.0 << "MB";
+    }
+    return ss.str();
+  }
+
+ private:
+  static const size_t kBlockSize = 1 << BlockBits;
+  // With huge pages, the blocks are cut from chunks of at least one huge
+  // page, a block alone is too small
+  static const size_t kBlocksPerChunk =
+      sizeof(Type) * kBlockSize >= kHugePageSize ?
+      1 : kHugePageSize / (sizeof(Type) * kBlockSize);
+  static const size_t kChunkSize = kBlocksPerChunk * sizeof(Type) * kBlockSize;
+
+  Type *NewBlock() {
+    if (!use_huge_pages_) return new Type[kBlockSize]();
+    if (blocks_.size() % kBlocksPerChunk == 0) {
+      chunks_.push_back(HugePageAlloc(kChunkSize));
+    }
+    Type *block = reinterpret_cast<Type *>(chunks_.back()) +
+                  blocks_.size() % kBlocksPerChunk * kBlockSize;
+    for (size_t i = 0; i < kBlockSize; i++) new (block + i) Type();
+    return block;
+  }
+
+  uint32_t size_;  // number of objects ever handed out
+  uint32_t free_;
+  uint32_t latest_deleted_;  // head of the implicit free list
+  std::vector<Type*> blocks_;
+  bool use_huge_pages_;
+  std::vector<void *> chunks_;  // only used with huge pages
+  DISALLOW_COPY_AND_ASSIGN(IndexedObjectPool);
+};
+
 }  // namespace xdecoder
 
 #endif  // OBJECT_POOL_H_
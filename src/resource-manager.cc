@@ -18,6 +18,7 @@
 #include "feature-pipeline.h"
 #include "thread-pool.h"
 #include "net.h"
+#include "batch-net.h"
 #include "decode-task.h"
 #include "resource-manager.h"
 
@@ -52,6 +53,8 @@ void Recognizer::set_decode_task(void *decode_task) {
 
 ResourceManager::ResourceManager(): beam_(13.0),
                                     max_active_(7000),
+                                    cutoff_bins_(0),
+                                    use_huge_pages_(false),
                                     acoustic_scale_(0.1f),
                                     skip_(0),
                                     max_batch_size_(16),
@@ -59,6 +62,8 @@ ResourceManager::ResourceManager(): beam_(13.0),
                                     am_left_context_(5),
                                     am_right_context_(5),
                                     thread_pool_size_(8),
+                                    batch_max_frames_(0),
+                                    batch_max_delay_ms_(5.0f),
                                     vad_num_bins_(40),
                                     vad_left_context_(5),
                                     vad_right_context_(5),
@@ -70,15 +75,27 @@ ResourceManager::ResourceManager(): beam_(13.0),
                                     decodable_options_(NULL),
                                     feature_options_(NULL),
                                     vad_options_(NULL),
+                                    batch_options_(NULL),
                                     thread_pool_(NULL),
                                     hclg_(NULL),
                                     tree_(NULL),
                                     pdf_prior_(NULL),
-                                    words_table_(NULL) {}
+                                    words_table_(NULL),
+                                    am_cmvn_(NULL),
+                                    vad_cmvn_(NULL),
+                                    am_net_(NULL),
+                                    vad_net_(NULL),
+                                    am_batch_net_(NULL) {}
 
 ResourceManager::~ResourceManager() {
+  // Before the thread pool, the batch net reschedules the tasks of its
+  // pending requests on it
+  if (am_batch_net_ != NULL)
+    delete reinterpret_cast<BatchNet*>(am_batch_net_);
   if (thread_pool_ != NULL)
     delete reinterpret_cast<ThreadPool*>(thread_pool_);
+  if (batch_options_ != NULL)
+    delete reinterpret_cast<BatchNetOptions*>(batch_options_);
 
   if (faster_decoder_options_ != NULL)
     delete reinterpret_cast<FasterDecoderOptions*>(faster_decoder_options_);
@@ -96,10 +113,18 @@ ResourceManager::~ResourceManager() {
     delete reinterpret_cast<Vector<float>*>(pdf_prior_);
   if (words_table_ != NULL)
     delete reinterpret_cast<SymbolTable*>(words_table_);
+  if (am_cmvn_ != NULL)
+    delete reinterpret_cast<Matrix<float>*>(am_cmvn_);
+  if (vad_cmvn_ != NULL)
+    delete reinterpret_cast<Matrix<float>*>(vad_cmvn_);
+  if (am_net_ != NULL)
+    delete reinterpret_cast<Net*>(am_net_);
+  if (vad_net_ != NULL)
+    delete reinterpret_cast<Net*>(vad_net_);
 
   for (size_t i = 0; i < resource_pool_.size(); i++) {
     if (resource_pool_[i] != NULL)
-      delete reinterpret_cast<Net*>(resource_pool_[i]);
+      delete reinterpret_cast<DecodeResource*>(resource_pool_[i]);
   }
 }
 
@@ -111,6 +136,14 @@ void ResourceManager::set_max_active(int max_active) {
   max_active_ = max_active;
 }
 
+void ResourceManager::set_cutoff_bins(int cutoff_bins) {
+  cutoff_bins_ = cutoff_bins;
+}
+
+void ResourceManager::set_use_huge_pages(bool use_huge_pages) {
+  use_huge_pages_ = use_huge_pages;
+}
+
 void ResourceManager::set_acoustic_scale(float acoustic_scale) {
   acoustic_scale_ = acoustic_scale;
 }
@@ -167,6 +200,14 @@ void ResourceManager::set_thread_pool_size(int size) {
   thread_pool_size_ = size;
 }
 
+void ResourceManager::set_batch_max_frames(int max_frames) {
+  batch_max_frames_ = max_frames;
+}
+
+void ResourceManager::set_batch_max_delay(float delay_ms) {
+  batch_max_delay_ms_ = delay_ms;
+}
+
 void ResourceManager::set_am_cmvn(const std::string& cmvn) {
   am_cmvn_file_ = cmvn;
 }
@@ -203,6 +244,7 @@ void ResourceManager::init() {
   FasterDecoderOptions* faster_decoder_options = new FasterDecoderOptions();
   faster_decoder_options->beam = beam_;
   faster_decoder_options->max_active = max_active_;
+  faster_decoder_options->cutoff_bins = cutoff_bins_;
   faster_decoder_options_ = reinterpret_cast<void*>(faster_decoder_options);
 
   DecodableOptions* decodable_options = new DecodableOptions();
@@ -234,10 +276,19 @@ void ResourceManager::init() {
   vad_options_ = reinterpret_cast<void*>(vad_options);
 
   CHECK(hclg_file_ != "");
-  hclg_ = reinterpret_cast<void*>(new Fst(hclg_file_));
+  SetUseHugePages(use_huge_pages_);
+  Fst *hclg = new Fst(hclg_file_);
+  if (use_huge_pages_) LOG("%s", hclg->HugePageReport().c_str());
+  hclg_ = reinterpret_cast<void*>(hclg);
 
   CHECK(tree_file_ != "");
-  tree_ = reinterpret_cast<void*>(new Tree(tree_file_));
+  Tree *tree = new Tree(tree_file_);
+  // The decoder indexes the frame costs by ilabel without checking
+  if (hclg->MaxIlabel() >= tree->NumTransitionIds()) {
+    ERROR("hclg ilabel %d out of the %d transition ids of the tree",
+          hclg->MaxIlabel(), tree->NumTransitionIds());
+  }
+  tree_ = reinterpret_cast<void*>(tree);
 
   CHECK(pdf_prior_file_ != "");
   Vector<float> *pdf_prior = new Vector<float>();
@@ -247,11 +298,33 @@ void ResourceManager::init() {
   CHECK(words_table_file_ != "");
   words_table_ = reinterpret_cast<void*>(new SymbolTable(words_table_file_));
 
+  Matrix<float> *am_cmvn = new Matrix<float>();
+  am_cmvn->Read(am_cmvn_file_);
+  CHECK(am_cmvn->NumCols() == am_num_bins_);
+  am_cmvn_ = reinterpret_cast<void*>(am_cmvn);
+
+  Matrix<float> *vad_cmvn = new Matrix<float>();
+  vad_cmvn->Read(vad_cmvn_file_);
+  CHECK(vad_cmvn->NumCols() == vad_num_bins_);
+  vad_cmvn_ = reinterpret_cast<void*>(vad_cmvn);
+
+  CHECK(am_net_file_ != "");
+  am_net_ = reinterpret_cast<void*>(new Net(am_net_file_));
+  vad_net_ = reinterpret_cast<void*>(new Net(vad_net_file_));
+
+  if (batch_max_frames_ > 0) {
+    BatchNetOptions* batch_options = new BatchNetOptions();
+    batch_options->max_batch_size = batch_max_frames_;
+    batch_options->max_delay_ms = batch_max_delay_ms_;
+    batch_options_ = reinterpret_cast<void*>(batch_options);
+    am_batch_net_ = reinterpret_cast<void*>(
+        new BatchNet(*reinterpret_cast<Net*>(am_net_), *batch_options));
+  }
+
   CHECK(thread_pool_size_ > 0);
   resource_pool_.resize(thread_pool_size_, NULL);
   for (int i = 0; i < thread_pool_size_; i++) {
-    Net *am_net = new Net(am_net_file_);
-    resource_pool_[i] = reinterpret_cast<void *>(am_net);
+    resource_pool_[i] = reinterpret_cast<void *>(new DecodeResource());
   }
   thread_pool_ = reinterpret_cast<void *>(
                      new ThreadPool(thread_pool_size_, &resource_pool_));
@@ -268,9 +341,15 @@ void ResourceManager::add_recognizer(Recognizer *recognizer) {
       *(reinterpret_cast<Fst*>(hclg_)),
       *(reinterpret_cast<Tree*>(tree_)),
       *(reinterpret_cast<Vector<float>*>(pdf_prior_)),
-      *(reinterpret_cast<SymbolTable*>(words_table_)));
+      *(reinterpret_cast<SymbolTable*>(words_table_)),
+      *(reinterpret_cast<Matrix<float>*>(am_cmvn_)),
+      *(reinterpret_cast<Matrix<float>*>(vad_cmvn_)),
+      *(reinterpret_cast<Net*>(am_net_)),
+      *(reinterpret_cast<Net*>(vad_net_)),
+      reinterpret_cast<ThreadPool*>(thread_pool_),
+      reinterpret_cast<BatchNet*>(am_batch_net_));
+  // The task is scheduled on the thread pool by the arriving audio data
   recognizer->set_decode_task(task);
-  reinterpret_cast<ThreadPool*>(thread_pool_)->AddTask(task);
 }
 
 
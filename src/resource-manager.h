@@ -46,6 +46,10 @@ class ResourceManager {
 
   void set_beam(float beam);
   void set_max_active(int max_active);
+  // Histogram bins per beam for the max active cutoff, 0 means exact
+  void set_cutoff_bins(int cutoff_bins);
+  // Huge pages for the graph and the token pools, see huge-page.h
+  void set_use_huge_pages(bool use_huge_pages);
   void set_acoustic_scale(float acoustic_scale);
   void set_skip(int skip);
   void set_max_batch_size(int max_batch_size);
@@ -71,6 +75,9 @@ class ResourceManager {
   void set_lexicon(const std::string& lexicon);
 
   void set_thread_pool_size(int size);
+  // Cross session batching of am net forward, 0 means disabled
+  void set_batch_max_frames(int max_frames);
+  void set_batch_max_delay(float delay_ms);
 
   void init();
   void add_recognizer(Recognizer *recognizer);
@@ -79,6 +86,8 @@ class ResourceManager {
   // FasterDecoderOptions
   float beam_;
   int max_active_;
+  int cutoff_bins_;
+  bool use_huge_pages_;
 
   // DecodableOptions
   float acoustic_scale_;
@@ -93,6 +102,10 @@ class ResourceManager {
   // ThreadPool number
   int thread_pool_size_;
 
+  // BatchNetOptions
+  int batch_max_frames_;
+  float batch_max_delay_ms_;
+
   // Vad FeaturePipelineConfig
   int vad_num_bins_;
   int vad_left_context_;
@@ -116,11 +129,19 @@ class ResourceManager {
   void* decodable_options_;
   void* feature_options_;
   void* vad_options_;
+  void* batch_options_;
   void* thread_pool_;
   void* hclg_;
   void* tree_;
   void* pdf_prior_;
   void* words_table_;
+  // Models shared by all the sessions, loaded once in init(), so creating
+  // a new session does not touch the disk
+  void* am_cmvn_;
+  void* vad_cmvn_;
+  void* am_net_;
+  void* vad_net_;
+  void* am_batch_net_;
   std::vector<void *> resource_pool_;
 };
 
@@ -40,14 +40,11 @@ class SymbolTable {
     return symbol_tabel_[id];
   }
 
-  // GetId is used in the construction fst period
-  // so here just a lazy/inefficient implemenation
+  // return -1 if not find
   int32_t GetId(const std::string &symbol) const {
-    for (uint32_t i = 0; i < symbol_tabel_.size(); i++) {
-      if (symbol == symbol_tabel_[i]) return static_cast<int32_t>(i);
-    }
-    // return -f if not find
-    return -1;
+    std::unordered_map<std::string, int32_t>::const_iterator it =
+        id_table_.find(symbol);
+    return it != id_table_.end() ? it->second : -1;
   }
 
   bool HaveId(int32_t id) const {
@@ -72,12 +69,14 @@ class SymbolTable {
 
       std::string symbol = str;
       symbol_tabel_[id] = symbol;
+      id_table_[symbol] = id;
     }
     fclose(fp);
   }
 
  private:
   mutable std::unordered_map<int32_t, std::string> symbol_tabel_;
+  std::unordered_map<std::string, int32_t> id_table_;
   DISALLOW_COPY_AND_ASSIGN(SymbolTable);
 };
 
@@ -0,0 +1,151 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TOKEN_MAP_H_
+#define TOKEN_MAP_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "utils.h"
+
+namespace xdecoder {
+
+// TokenMap maps decoding graph states to tokens for one frame, it takes the
+// place of HashList in FasterDecoder.
+// 1. open addressing with linear probing, the table size is a power of two,
+//    so the slot is found by masking instead of modulo.
+// 2. every slot is stamped with the generation it was written in, Clear()
+//    just bumps the generation, so it is O(1) whatever the table size.
+// 3. the elements live in a dense array in insertion order, which is what
+//    the decoder iterates over, the slots only store the key and the index
+//    of the element.
+// 4. SetSize() may shrink the table as well as grow it, and Insert() grows
+//    it when the load factor exceeds 1/2.
+// I must be an integer type.
+template<class I, class T>
+class TokenMap {
+ public:
+  struct Elem {
+    I key;
+    T val;
+  };
+
+  TokenMap(): mask_(0), generation_(1) {
+    Rehash(kMinSize);
+  }
+
+  // Tells the map how many slots to allocate, rounded up to a power of two.
+  // It should typically be at least twice the number of elements expected.
+  // Must be called while the map is empty (eg. after Clear()).
+  void SetSize(size_t size) {
+    CHECK(elems_.empty());
+    size_t num_slots = kMinSize;
+    while (num_slots < size) num_slots *= 2;
+    // only shrink when it's much too big, to avoid reallocating every frame
+    if (num_slots > slots_.size() || num_slots * 8 < slots_.size()) {
+      Rehash(num_slots);
+    }
+  }
+
+  // Number of elements
+  size_t Size() const { return elems_.size(); }
+
+  // Number of slots in the table
+  size_t Capacity() const { return slots_.size(); }
+
+  // Gives all the elements to the caller by swapping them into *list, and
+  // clears the map in O(1). The previous content of *list is dropped.
+  void Clear(std::vector<Elem> *list) {
+    list->swap(elems_);
+    Clear();
+  }
+
+  void Clear() {
+    elems_.clear();
+    generation_++;
+    if (generation_ == 0) {  // wrapped, stale stamps may look valid again
+      for (size_t i = 0; i < slots_.size(); i++) slots_[i].generation = 0;
+      generation_ = 1;
+    }
+  }
+
+  // The elements in insertion order
+  const std::vector<Elem>& GetList() const { return elems_; }
+
+  // Returns NULL if key is not present. The returned pointer is invalidated
+  // by the next Insert(), but the caller is free to modify its val.
+  inline Elem *Find(const I &key) {
+    for (size_t i = Hash(key); ; i = (i + 1) & mask_) {
+      const Slot &slot = slots_[i];
+      if (slot.generation != generation_) return NULL;
+      if (slot.key == key) return &elems_[slot.index];
+    }
+  }
+
+  // The caller asserts that key is not present, eg. Find() returned NULL.
+  inline Elem *Insert(const I &key, T val) {
+    if ((elems_.size() + 1) * 2 > slots_.size()) {
+      Rehash(slots_.size() * 2);
+    }
+    size_t i = Hash(key);
+    while (slots_[i].generation == generation_) i = (i + 1) & mask_;
+    slots_[i].generation = generation_;
+    slots_[i].key = key;
+    slots_[i].index = static_cast<uint32_t>(elems_.size());
+    Elem elem = { key, val };
+    elems_.push_back(elem);
+    return &elems_.back();
+  }
+
+ private:
+  struct Slot {
+    uint32_t generation;
+    I key;  // a copy of the key, so probing doesn't touch elems_
+    uint32_t index;  // index in elems_
+  };
+
+  static const size_t kMinSize = 16;
+
+  inline size_t Hash(const I &key) const {
+    uint32_t h = static_cast<uint32_t>(key) * 0x9e3779b1u;
+    return (h ^ (h >> 16)) & mask_;
+  }
+
+  // Reallocates the table with num_slots slots, and inserts elems_ again
+  void Rehash(size_t num_slots) {
+    slots_.assign(num_slots, Slot());
+    mask_ = num_slots - 1;
+    generation_ = 1;
+    for (size_t n = 0; n < elems_.size(); n++) {
+      size_t i = Hash(elems_[n].key);
+      while (slots_[i].generation == generation_) i = (i + 1) & mask_;
+      slots_[i].generation = generation_;
+      slots_[i].key = elems_[n].key;
+      slots_[i].index = static_cast<uint32_t>(n);
+    }
+  }
+
+  std::vector<Slot> slots_;
+  std::vector<Elem> elems_;
+  size_t mask_;
+  uint32_t generation_;
+  DISALLOW_COPY_AND_ASSIGN(TokenMap);
+};
+
+}  // namespace xdecoder
+
+#endif  // TOKEN_MAP_H_
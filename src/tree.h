@@ -86,11 +86,20 @@ class Tree {
     }
   }
 
+  int32_t NumTransitionIds() const {
+    return static_cast<int32_t>(transition_id_to_pdf_.size());
+  }
+
   int32_t TransitionIdToPdf(int32_t transition_id) const {
     CHECK(transition_id < static_cast<int32_t>(transition_id_to_pdf_.size()));
     return transition_id_to_pdf_[transition_id];
   }
 
+  // The whole table, indexed by transition id
+  const std::vector<int32_t>& TransitionIdToPdfTable() const {
+    return transition_id_to_pdf_;
+  }
+
  private:
   std::vector<int32_t> transition_id_to_pdf_;
 };
@@ -31,11 +31,28 @@ Vad::Vad(const VadConfig& config):
     speech_frame_count_(0),
     frame_count_(0),
     state_(kSilence),
-    net_(config.net_file),
+    own_net_(config.net_file),
+    net_(&own_net_),
+    workspace_(&own_workspace_),
     endpoint_detected_(false), t_(0) {
   audio_buffer_.reserve(kMaxAudioBuffer);
 }
 
+Vad::Vad(const VadConfig& config, const Matrix<float>& cmvn, const Net* net,
+         NetWorkspace* workspace):
+    config_(config),
+    feature_pipeline_(config.feature_config, cmvn),
+    silence_frame_count_(0),
+    speech_frame_count_(0),
+    frame_count_(0),
+    state_(kSilence),
+    net_(net),
+    workspace_(workspace),
+    endpoint_detected_(false), t_(0) {
+  CHECK(net_ != NULL);
+  audio_buffer_.reserve(kMaxAudioBuffer);
+}
+
 void Vad::Reset() {
   silence_frame_count_ = 0;
   speech_frame_count_ = 0;
@@ -61,7 +78,8 @@ bool Vad::DoVad(const std::vector<float>& wave, bool end_of_stream,
   int feat_dim = feature_pipeline_.FeatureDim();
   if (num_frames > 0) {
     Matrix<float> in(feat.data(), num_frames, feat_dim), out;
-    net_.Forward(in, &out);
+    CHECK(workspace_ != NULL);
+    net_->Forward(in, &out, workspace_);
     assert(out.NumCols() == 2);
     endpoint_detected_ = false;
     bool contains_speech = false;
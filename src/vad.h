@@ -49,6 +49,11 @@ typedef enum {
 class Vad {
  public:
   explicit Vad(const VadConfig& config);
+  // Use the cmvn and net which are already loaded by the caller,
+  // config.net_file and config.feature_config.cmvn_file are ignored.
+  // workspace can be NULL here and be set by SetWorkspace() before DoVad()
+  Vad(const VadConfig& config, const Matrix<float>& cmvn, const Net* net,
+      NetWorkspace* workspace);
   // return true is contains endpoint
   bool DoVad(const std::vector<float>& wave, bool end_of_stream,
              std::vector<float>* speech = NULL);
@@ -63,13 +68,17 @@ class Vad {
     feature_pipeline_.SetDone();
   }
   void Lookback();
+  void SetWorkspace(NetWorkspace* workspace) { workspace_ = workspace; }
 
  private:
   const VadConfig& config_;
   FeaturePipeline feature_pipeline_;
   int silence_frame_count_, speech_frame_count_, frame_count_;
   VadState state_;
-  Net net_;
+  Net own_net_;
+  NetWorkspace own_workspace_;
+  const Net* net_;
+  NetWorkspace* workspace_;
   bool endpoint_detected_;
   std::vector<bool> results_;
   std::vector<float> audio_buffer_;
@@ -55,7 +55,25 @@ class Varint {
     return ZigzagToInt32(zigzag);
   }
 
- private:
+  // Reads a varint from memory, returns the byte after it
+  static inline const uint8_t* ReadUint32FromArray(const uint8_t* p,
+                                                   uint32_t* value) {
+    uint32_t ret = *p++;
+    if (ret < 0x80) {  // most labels and deltas take one byte
+      *value = ret;
+      return p;
+    }
+    ret &= 0x7f;
+    for (int offset = 7; ; offset += 7) {
+      uint8_t ch = *p++;
+      ret |= static_cast<uint32_t>(ch & 0x7f) << offset;
+      if (ch < 0x80) break;
+      CHECK(offset < 7 * (kMaxVarint32Bytes - 1));
+    }
+    *value = ret;
+    return p;
+  }
+
   static uint8_t* WriteVarint32ToArray(uint32_t value, uint8_t* target) {
     while (value >= 0x80) {
       *target = static_cast<uint8_t>(value | 0x80);
@@ -66,6 +84,7 @@ class Varint {
     return target + 1;
   }
 
+ private:
   static int WriteVarint32(std::ostream& os, int32_t value) {
     uint8_t bytes[kMaxVarint32Bytes];
     uint8_t* target = &bytes[0];
@@ -0,0 +1,136 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include <sstream>
+#include <vector>
+
+#include "batch-net.h"
+#include "net.h"
+#include "thread-pool.h"
+
+// Same as in net-test.cc
+static xdecoder::FullyConnect* NewFullyConnect(
+    const xdecoder::Matrix<float>& w, const xdecoder::Vector<float>& b) {
+  std::stringstream ss;
+  char type = xdecoder::kFullyConnect;
+  int32_t in_dim = w.NumCols(), out_dim = w.NumRows();
+  ss.write(&type, 1);
+  ss.write(reinterpret_cast<const char *>(&in_dim), sizeof(int32_t));
+  ss.write(reinterpret_cast<const char *>(&out_dim), sizeof(int32_t));
+  w.Write(ss);
+  b.Write(ss);
+  xdecoder::FullyConnect* fc = new xdecoder::FullyConnect();
+  fc->Read(ss);
+  return fc;
+}
+
+// Counts the finished tasks
+struct Counter {
+  int count;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+// Sends its rows to the batch net in the first run, and checks the output
+// against Net::Forward() when it is scheduled again by the batch net
+class ForwardTask : public xdecoder::Threadable {
+ public:
+  ForwardTask(const xdecoder::Net& net, xdecoder::BatchNet* batch_net,
+              xdecoder::ThreadPool* thread_pool, Counter* counter,
+              int id, int rows):
+      net_(net), batch_net_(batch_net), thread_pool_(thread_pool),
+      counter_(counter), in_(rows, net.InDim()), submitted_(false) {
+    for (int i = 0; i < in_.Size(); i++) {
+      in_.Data()[i] = ((i * 7 + id * 13) % 23 - 11) * 0.1f;
+    }
+  }
+  virtual void operator() (void *resource) {
+    if (!submitted_) {
+      submitted_ = true;
+      batch_net_->Forward(in_, &out_, thread_pool_, this);
+      return;
+    }
+    xdecoder::Matrix<float> expected;
+    xdecoder::NetWorkspace workspace;
+    net_.Forward(in_, &expected, &workspace);
+    CHECK(out_.NumRows() == expected.NumRows());
+    CHECK(out_.NumCols() == expected.NumCols());
+    for (int i = 0; i < out_.Size(); i++) {
+      CHECK(fabsf(out_.Data()[i] - expected.Data()[i]) < 1e-4);
+    }
+    pthread_mutex_lock(&counter_->mutex);
+    counter_->count++;
+    pthread_mutex_unlock(&counter_->mutex);
+    pthread_cond_signal(&counter_->cond);
+  }
+
+ private:
+  const xdecoder::Net& net_;
+  xdecoder::BatchNet* batch_net_;
+  xdecoder::ThreadPool* thread_pool_;
+  Counter* counter_;
+  xdecoder::Matrix<float> in_, out_;
+  bool submitted_;
+};
+
+// The workers don't wait for the batch net, so a batch has many more
+// requests than the thread pool has workers
+int main() {
+  const int in_dim = 20, out_dim = 10, num_threads = 2, num_tasks = 32,
+            rows = 4;
+  xdecoder::Matrix<float> w(out_dim, in_dim);
+  xdecoder::Vector<float> b(out_dim);
+  for (int i = 0; i < w.Size(); i++) w.Data()[i] = (i % 17 - 8) * 0.05f;
+  for (int i = 0; i < out_dim; i++) b(i) = i * 0.1f;
+  xdecoder::Net net;
+  net.AddLayer(NewFullyConnect(w, b));
+
+  Counter counter;
+  counter.count = 0;
+  pthread_mutex_init(&counter.mutex, NULL);
+  pthread_cond_init(&counter.cond, NULL);
+  // Waits for all the requests, the batch is full then
+  xdecoder::BatchNetOptions options;
+  options.max_batch_size = num_tasks * rows;
+  options.max_delay_ms = 10000.0f;
+  std::vector<ForwardTask*> tasks;
+  {
+    xdecoder::ThreadPool thread_pool(num_threads);
+    xdecoder::BatchNet batch_net(net, options);
+    for (int i = 0; i < num_tasks; i++) {
+      tasks.push_back(new ForwardTask(net, &batch_net, &thread_pool,
+                                      &counter, i, rows));
+      thread_pool.AddTask(tasks[i]);
+    }
+    pthread_mutex_lock(&counter.mutex);
+    while (counter.count < num_tasks) {
+      pthread_cond_wait(&counter.cond, &counter.mutex);
+    }
+    pthread_mutex_unlock(&counter.mutex);
+    printf("%d threads, %ld batches, max requests per batch %d\n",
+           num_threads, batch_net.NumBatches(),
+           batch_net.MaxBatchRequests());
+    CHECK(batch_net.NumRequests() == num_tasks);
+    CHECK(batch_net.MaxBatchRequests() > num_threads);
+  }
+  for (int i = 0; i < num_tasks; i++) delete tasks[i];
+  pthread_mutex_destroy(&counter.mutex);
+  pthread_cond_destroy(&counter.cond);
+  return 0;
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "compressed-fst.h"
+#include "fst.h"
+
+using xdecoder::Arc;
+using xdecoder::CompressedFst;
+using xdecoder::Fst;
+
+// A random fst with epsilon arcs, large labels, next states far before and
+// after the state, so the deltas take several varint bytes, and a few
+// final states
+void RandomFst(int32_t num_states, Fst *fst) {
+  std::vector<std::vector<Arc> > all_arcs(num_states);
+  std::map<int32_t, float> finals;
+  for (int32_t i = 0; i < num_states; i++) {
+    int num_arcs = rand() % 5;
+    for (int j = 0; j < num_arcs; j++) {
+      int32_t ilabel = rand() % 3 == 0 ? 0 : rand() % (1 << 20);
+      int32_t olabel = rand() % 4 == 0 ? rand() % (1 << 24) : 0;
+      float weight = -5.0f + 35.0f * rand() / RAND_MAX;
+      int32_t next_state;
+      switch (rand() % 3) {
+        case 0: next_state = i; break;
+        case 1: next_state = std::min(num_states - 1, i + rand() % 8); break;
+        default: next_state = rand() % num_states; break;
+      }
+      all_arcs[i].push_back(Arc(ilabel, olabel, weight, next_state));
+    }
+    if (i % 7 == 3) finals[i] = 0.1f * (i % 13);
+  }
+  // an arc to the far end and back
+  all_arcs[0].push_back(Arc(5, 0, 1.0f, num_states - 1));
+  all_arcs[num_states - 1].push_back(Arc(0, 7, 2.0f, 0));
+  fst->Init(&all_arcs, finals);
+  fst->SetStart(num_states / 2);
+}
+
+// The arcs of state in fst and cfst are the same, weights within half a
+// quantization step
+template <class FST, class CFST>
+void CompareArcs(const FST& fst, const CFST& cfst, int32_t state, bool eps,
+                 float max_error) {
+  typename FST::ArcIterator aiter(fst, state, eps);
+  typename CFST::ArcIterator caiter(cfst, state, eps);
+  for (; !aiter.Done(); aiter.Next(), caiter.Next()) {
+    CHECK(!caiter.Done());
+    const Arc& arc = aiter.Value();
+    const Arc& carc = caiter.Value();
+    CHECK(caiter.Index() == aiter.Index());
+    CHECK(carc.ilabel == arc.ilabel);
+    CHECK(cfst.OLabel(caiter.Index()) == arc.olabel);
+    CHECK(carc.next_state == arc.next_state);
+    CHECK(fabsf(carc.weight - arc.weight) <= max_error);
+  }
+  CHECK(caiter.Done());
+}
+
+int main() {
+  srand(0);
+  const int32_t num_states = 100000;
+  Fst fst;
+  RandomFst(num_states, &fst);
+  CompressedFst compressed;
+  compressed.Init(fst);
+  const char *file = "test/compressed-fst-test.cfst";
+  compressed.Write(file);
+  CHECK(CompressedFst::IsCompressedFst(file));
+  CompressedFst cfst(file);
+  remove(file);
+
+  CHECK(cfst.Start() == fst.Start());
+  CHECK(cfst.NumStates() == fst.NumStates());
+  CHECK(cfst.NumArcs() == fst.NumArcs());
+  CHECK(cfst.NumFinals() == fst.NumFinals());
+  float weight_min = 1e10f, weight_max = -1e10f;
+  for (int32_t i = 0; i < fst.NumArcs(); i++) {
+    weight_min = std::min(weight_min, fst.GetArc(i).weight);
+    weight_max = std::max(weight_max, fst.GetArc(i).weight);
+  }
+  // half a step of the 16 bit quantization, and the float rounding
+  float max_error = (weight_max - weight_min) / 65535 / 2 + 1e-5f;
+  for (int32_t i = 0; i < fst.NumStates(); i++) {
+    CHECK(cfst.IsFinal(i) == fst.IsFinal(i));
+    if (fst.IsFinal(i)) CHECK(cfst.Final(i) == fst.Final(i));
+    CHECK(cfst.NumArcs(i) == fst.NumArcs(i));
+    CompareArcs(fst, cfst, i, true, max_error);
+    CompareArcs(fst, cfst, i, false, max_error);
+  }
+  printf("%d states %d arcs, %ld bytes compressed, max weight error %g\n",
+         fst.NumStates(), fst.NumArcs(), cfst.ArcBytes(), max_error);
+  return 0;
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "faster-decoder.h"
+#include "fst.h"
+
+namespace xdecoder {
+
+// Exposes the cutoffs of FasterDecoder for tokens of given costs
+class CutoffTester : public FasterDecoder {
+ public:
+  CutoffTester(const Fst& fst, const FasterDecoderOptions& config):
+      FasterDecoder(fst, config) {}
+
+  // Exact cutoff by GetCutoff() with nth_element, and the histogram one
+  // by GetHistogramCutoff(), returns false if the histogram failed
+  bool Cutoffs(const std::vector<float>& costs, int32_t cutoff_bins,
+               double *exact, double *histogram) {
+    std::vector<Elem> toks(costs.size());
+    for (size_t i = 0; i < costs.size(); i++) {
+      toks[i].key = static_cast<int32_t>(i);
+      toks[i].val = NewToken(kNoArc, costs[i], kNoToken);
+    }
+    size_t exact_count = 0, histogram_count = 0;
+    float exact_beam = 0.0f, histogram_beam = 0.0f;
+    const Elem *exact_best = NULL, *histogram_best = NULL;
+    config_.cutoff_bins = 0;
+    *exact = GetCutoff(toks, &exact_count, &exact_beam, &exact_best);
+    config_.cutoff_bins = cutoff_bins;
+    bool ok = GetHistogramCutoff(toks, &histogram_count, &histogram_beam,
+                                 &histogram_best, histogram);
+    if (ok) {
+      CHECK(histogram_count == exact_count);
+      CHECK(histogram_best == exact_best);
+    }
+    for (size_t i = 0; i < toks.size(); i++) TokenDelete(toks[i].val);
+    return ok;
+  }
+};
+
+}  // namespace xdecoder
+
+using xdecoder::CutoffTester;
+
+// Costs uniform in [0, span), the first one is the anchor of the histogram
+std::vector<float> RandomCosts(int n, float span, float anchor) {
+  std::vector<float> costs(n);
+  for (int i = 0; i < n; i++) {
+    costs[i] = span * rand() / (static_cast<float>(RAND_MAX) + 1);
+  }
+  costs[0] = anchor;
+  return costs;
+}
+
+int NumBelow(const std::vector<float>& costs, double cutoff) {
+  int n = 0;
+  for (size_t i = 0; i < costs.size(); i++) {
+    if (costs[i] < cutoff) n++;
+  }
+  return n;
+}
+
+// The histogram cutoff is within a bin of the exact one, on the side which
+// keeps max_active at most and min_active at least
+void TestHistogramCutoff(int32_t cutoff_bins) {
+  xdecoder::Fst fst;
+  xdecoder::FasterDecoderOptions options;
+  options.beam = 16.0f;
+  options.max_active = 1000;
+  options.min_active = 70;
+  CutoffTester tester(fst, options);
+  double bin_width = options.beam / cutoff_bins, exact, histogram;
+
+  // max_active, 5000 tokens within the beam
+  std::vector<float> costs = RandomCosts(5000, 12.0f, 6.0f);
+  CHECK(tester.Cutoffs(costs, cutoff_bins, &exact, &histogram));
+  double best = *std::min_element(costs.begin(), costs.end());
+  CHECK(exact < best + options.beam);
+  CHECK(NumBelow(costs, exact) == options.max_active);
+  CHECK(histogram <= exact && exact - histogram < bin_width);
+  CHECK(NumBelow(costs, histogram) <= options.max_active);
+
+  // min_active, 100 tokens over twice the beam
+  costs = RandomCosts(100, 30.0f, 14.5f);
+  CHECK(tester.Cutoffs(costs, cutoff_bins, &exact, &histogram));
+  best = *std::min_element(costs.begin(), costs.end());
+  CHECK(exact > best + options.beam);
+  CHECK(NumBelow(costs, exact) == options.min_active);
+  CHECK(histogram >= exact && histogram - exact < bin_width);
+  CHECK(NumBelow(costs, histogram) >= options.min_active);
+
+  // beam, between min_active and max_active tokens within the beam
+  costs = RandomCosts(500, 30.0f, 10.0f);
+  CHECK(tester.Cutoffs(costs, cutoff_bins, &exact, &histogram));
+  best = *std::min_element(costs.begin(), costs.end());
+  CHECK(exact == best + options.beam);
+  // the histogram adds the beam in float
+  CHECK(fabs(histogram - exact) < 1e-5);
+
+  // a token below the range of the histogram, it falls back to GetCutoff()
+  costs = RandomCosts(500, 30.0f, 25.0f);
+  costs[1] = 1.0f;
+  CHECK(!tester.Cutoffs(costs, cutoff_bins, &exact, &histogram));
+  printf("cutoff bins %d ok\n", cutoff_bins);
+}
+
+int main() {
+  srand(0);
+  int32_t bins[] = { 4, 16, 64, 256 };
+  for (size_t i = 0; i < sizeof(bins) / sizeof(bins[0]); i++) {
+    TestHistogramCutoff(bins[i]);
+  }
+  return 0;
+}
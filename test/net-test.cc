@@ -0,0 +1,284 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "net.h"
+
+// FullyConnect read from the weights w and the bias b
+static xdecoder::FullyConnect* NewFullyConnect(
+    const xdecoder::Matrix<float>& w, const xdecoder::Vector<float>& b) {
+  std::stringstream ss;
+  char type = xdecoder::kFullyConnect;
+  int32_t in_dim = w.NumCols(), out_dim = w.NumRows();
+  ss.write(&type, 1);
+  ss.write(reinterpret_cast<const char *>(&in_dim), sizeof(int32_t));
+  ss.write(reinterpret_cast<const char *>(&out_dim), sizeof(int32_t));
+  w.Write(ss);
+  b.Write(ss);
+  xdecoder::FullyConnect* fc = new xdecoder::FullyConnect();
+  fc->Read(ss);
+  return fc;
+}
+
+// FullyConnect + Sigmoid, which Net::Forward runs fused, against the plain
+// loops
+void TestFusedForward() {
+  const int in_dim = 13, out_dim = 1027, num_rows = 100;
+  xdecoder::Matrix<float> w(out_dim, in_dim), in(num_rows, in_dim);
+  xdecoder::Vector<float> b(out_dim);
+  for (int i = 0; i < w.Size(); i++) w.Data()[i] = (i % 17 - 8) * 0.01f;
+  for (int i = 0; i < b.Size(); i++) b.Data()[i] = (i % 5 - 2) * 0.1f;
+  for (int i = 0; i < in.Size(); i++) in.Data()[i] = (i % 11 - 5) * 0.1f;
+
+  xdecoder::Net net;
+  net.AddLayer(NewFullyConnect(w, b));
+  net.AddLayer(new xdecoder::Sigmoid(out_dim, out_dim));
+  xdecoder::Matrix<float> out;
+  net.Forward(in, &out);
+
+  float err = 0.0f;
+  for (int i = 0; i < num_rows; i++) {
+    for (int j = 0; j < out_dim; j++) {
+      float sum = b(j);
+      for (int k = 0; k < in_dim; k++) sum += in(i, k) * w(j, k);
+      err = std::max(err, fabsf(out(i, j) - 1.0f / (1.0f + expf(-sum))));
+    }
+  }
+  printf("fused fc sigmoid max error %g\n", err);
+  CHECK(err < 1e-5);
+
+  // a copy of the layers gives the same output
+  xdecoder::Net copy_net;
+  for (int32_t i = 0; i < net.NumLayers(); i++) {
+    copy_net.AddLayer(net.GetLayer(i)->Copy());
+  }
+  xdecoder::Matrix<float> copy_out;
+  copy_net.Forward(in, &copy_out);
+  CHECK(memcmp(out.Data(), copy_out.Data(), out.Size() * sizeof(float)) == 0);
+}
+
+// FC ReLU FC ReLU FC quantized by calibrated ranges, which Net::Forward
+// runs in uint8 up to the last layer, against the float net
+void TestIntegerPipeline() {
+  const int dims[] = {40, 64, 48, 10}, num_rows = 37;
+  xdecoder::Net net;
+  for (int l = 0; l < 3; l++) {
+    xdecoder::Matrix<float> w(dims[l + 1], dims[l]);
+    xdecoder::Vector<float> b(dims[l + 1]);
+    for (int i = 0; i < w.Size(); i++) {
+      w.Data()[i] = ((i * 7 + l) % 23 - 11) * 0.02f;
+    }
+    for (int i = 0; i < b.Size(); i++) b.Data()[i] = (i % 7 - 3) * 0.05f;
+    net.AddLayer(NewFullyConnect(w, b));
+    if (l < 2) net.AddLayer(new xdecoder::ReLU(dims[l + 1], dims[l + 1]));
+  }
+  xdecoder::Matrix<float> in(num_rows, dims[0]), out, quantize_out;
+  for (int i = 0; i < in.Size(); i++) {
+    in.Data()[i] = ((i * 13) % 101 - 50) * 0.02f;
+  }
+  net.Forward(in, &out);
+
+  xdecoder::NetWorkspace workspace;
+  std::vector<float> in_min, in_max;
+  net.UpdateInputRange(in, &workspace, &in_min, &in_max);
+  xdecoder::Net quantize_net;
+  net.Quantize(in_min, in_max, &quantize_net);
+  quantize_net.Forward(in, &quantize_out);
+
+  float err = 0.0f, max = 0.0f;
+  for (int i = 0; i < out.Size(); i++) {
+    err = std::max(err, fabsf(out.Data()[i] - quantize_out.Data()[i]));
+    max = std::max(max, fabsf(out.Data()[i]));
+  }
+  printf("integer pipeline max error %g of %g\n", err, max);
+  CHECK(err < 0.05 * max);
+
+  // a frame doesn't depend on the batch
+  xdecoder::Matrix<float> row(in.Data(), 1, dims[0]), row_out;
+  quantize_net.Forward(row, &row_out);
+  for (int j = 0; j < row_out.NumCols(); j++) {
+    CHECK(row_out(0, j) == quantize_out(0, j));
+  }
+}
+
+// The relu of the first layer is always 0 on the calibration data, so the
+// input range of the second layer is all zeros, its output is its bias and
+// it is requantized to the third layer
+void TestDeadLayerQuantize() {
+  const int dims[] = {16, 8, 6, 4}, num_rows = 5;
+  xdecoder::Net net;
+  for (int l = 0; l < 3; l++) {
+    xdecoder::Matrix<float> w(dims[l + 1], dims[l]);
+    xdecoder::Vector<float> b(dims[l + 1]);
+    for (int i = 0; i < w.Size(); i++) w.Data()[i] = (i % 7 - 3) * 0.1f;
+    for (int i = 0; i < b.Size(); i++) {
+      b.Data()[i] = l == 0 ? -10.0f : (i % 5 - 1.5f) * 0.4f;
+    }
+    net.AddLayer(NewFullyConnect(w, b));
+    if (l < 2) net.AddLayer(new xdecoder::ReLU(dims[l + 1], dims[l + 1]));
+  }
+  xdecoder::Matrix<float> in(num_rows, dims[0]), out, quantize_out;
+  for (int i = 0; i < in.Size(); i++) in.Data()[i] = (i % 9 - 4) * 0.1f;
+  net.Forward(in, &out);
+
+  xdecoder::NetWorkspace workspace;
+  std::vector<float> in_min, in_max;
+  net.UpdateInputRange(in, &workspace, &in_min, &in_max);
+  CHECK(in_min[2] == 0.0f && in_max[2] == 0.0f);
+  xdecoder::Net quantize_net;
+  net.Quantize(in_min, in_max, &quantize_net);
+  quantize_net.Forward(in, &quantize_out);
+
+  float err = 0.0f, max = 0.0f;
+  for (int i = 0; i < out.Size(); i++) {
+    err = std::max(err, fabsf(out.Data()[i] - quantize_out.Data()[i]));
+    max = std::max(max, fabsf(out.Data()[i]));
+  }
+  printf("dead layer max error %g of %g\n", err, max);
+  CHECK(max > 0.0f);
+  CHECK(err < 0.05 * max);
+
+  // the widened range is written, the bias is quantized again on read
+  const char* filename = "test/net-test.qnet";
+  quantize_net.Write(filename);
+  xdecoder::Net read_net;
+  read_net.Read(filename);
+  remove(filename);
+  xdecoder::Matrix<float> read_out;
+  read_net.Forward(in, &read_out);
+  for (int i = 0; i < out.Size(); i++) {
+    CHECK(read_out.Data()[i] == quantize_out.Data()[i]);
+  }
+}
+
+// Int8Gemm against the plain dot products, it is exact
+void TestInt8Gemm() {
+  const int rows = 7, cols = 13, depth = 2 * xdecoder::kInt8Align;
+  xdecoder::Matrix<int8_t> x(rows, depth), w(cols, depth);
+  xdecoder::Matrix<int32_t> out;
+  for (int i = 0; i < x.Size(); i++) x.Data()[i] = (i * 37) % 255 - 127;
+  for (int i = 0; i < w.Size(); i++) w.Data()[i] = (i * 91) % 255 - 127;
+  xdecoder::Int8Gemm(x, w, &out);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      int32_t sum = 0;
+      for (int k = 0; k < depth; k++) sum += x(i, k) * w(j, k);
+      CHECK(out(i, j) == sum);
+    }
+  }
+}
+
+// A layer with an outlier row, which costs the per tensor uint8 weights
+// the precision of all the other rows, but not the per row int8 ones
+void TestPerRowQuantize() {
+  const int in_dim = 100, out_dim = 64, num_rows = 16;
+  xdecoder::Matrix<float> w(out_dim, in_dim), in(num_rows, in_dim);
+  xdecoder::Vector<float> b(out_dim);
+  for (int i = 0; i < w.Size(); i++) {
+    w.Data()[i] = ((i * 7) % 41 - 20) * 0.005f;
+  }
+  for (int k = 0; k < in_dim; k++) w(0, k) *= 50;
+  for (int i = 0; i < in.Size(); i++) {
+    in.Data()[i] = ((i * 13) % 101 - 50) * 0.02f;
+  }
+  xdecoder::Net net, quantize_net, per_row_net;
+  net.AddLayer(NewFullyConnect(w, b));
+  net.Quantize(&quantize_net);
+  net.QuantizePerRow(&per_row_net);
+  xdecoder::Matrix<float> out, quantize_out, per_row_out;
+  net.Forward(in, &out);
+  quantize_net.Forward(in, &quantize_out);
+  per_row_net.Forward(in, &per_row_out);
+  // rows other than the outlier
+  float err = 0.0f, per_row_err = 0.0f;
+  for (int i = 0; i < num_rows; i++) {
+    for (int j = 1; j < out_dim; j++) {
+      err = std::max(err, fabsf(out(i, j) - quantize_out(i, j)));
+      per_row_err = std::max(per_row_err,
+                             fabsf(out(i, j) - per_row_out(i, j)));
+    }
+  }
+  printf("outlier row, uint8 max error %g, per row int8 max error %g\n",
+         err, per_row_err);
+  CHECK(per_row_err < err);
+  CHECK(per_row_err < 0.01);
+
+  // a narrow input range far from 0, whose zero point would be huge
+  xdecoder::Matrix<float> far_in(1, in_dim), far_out, far_per_row_out;
+  for (int k = 0; k < in_dim; k++) far_in(0, k) = 1000.0f + k * 1e-4f;
+  net.Forward(far_in, &far_out);
+  per_row_net.Forward(far_in, &far_per_row_out);
+  for (int j = 0; j < out_dim; j++) {
+    CHECK(fabsf(far_out(0, j) - far_per_row_out(0, j)) <
+          0.02 * fabsf(far_out(0, j)) + 0.1);
+  }
+}
+
+// Max absolute error of the activation kernels against libm, over [-20, 20]
+// and an odd length, so the padded tail is covered as well.
+int main() {
+  const int n = 40003;
+  std::vector<float> in(n), out(n);
+  for (int i = 0; i < n; i++) {
+    in[i] = -20.0f + 40.0f * i / (n - 1);
+  }
+
+  float err = 0.0f;
+  xdecoder::SigmoidData(in.data(), n, out.data());
+  for (int i = 0; i < n; i++) {
+    err = std::max(err, fabsf(out[i] - 1.0f / (1.0f + expf(-in[i]))));
+  }
+  printf("sigmoid max error %g\n", err);
+  CHECK(err < 1e-6);
+
+  err = 0.0f;
+  xdecoder::TanhData(in.data(), n, out.data());
+  for (int i = 0; i < n; i++) {
+    err = std::max(err, fabsf(out[i] - tanhf(in[i])));
+  }
+  printf("tanh max error %g\n", err);
+  CHECK(err < 1e-6);
+
+  xdecoder::ReLUData(in.data(), n, out.data());
+  for (int i = 0; i < n; i++) {
+    CHECK(out[i] == std::max(in[i], 0.0f));
+  }
+
+  // in place, as the net does it
+  std::vector<float> row(in.begin(), in.begin() + 4003);
+  xdecoder::SoftmaxData(row.data(), row.size(), row.data());
+  float max = *std::max_element(in.begin(), in.begin() + 4003), sum = 0.0f;
+  for (size_t i = 0; i < row.size(); i++) sum += expf(in[i] - max);
+  err = 0.0f;
+  for (size_t i = 0; i < row.size(); i++) {
+    err = std::max(err, fabsf(row[i] - expf(in[i] - max) / sum));
+  }
+  printf("softmax max error %g\n", err);
+  CHECK(err < 1e-6);
+
+  TestFusedForward();
+  TestIntegerPipeline();
+  TestDeadLayerQuantize();
+  TestInt8Gemm();
+  TestPerRowQuantize();
+  return 0;
+}
@@ -14,6 +14,7 @@
 // limitations under the License.
 
 #include <iostream>
+#include <vector>
 
 #include "object-pool.h"
 #include "timer.h"
@@ -25,6 +26,7 @@ struct Point {
 int main(int argc, char* argv[]) {
   using xdecoder::NaiveObjectPool;
   using xdecoder::CacheObjectPool;
+  using xdecoder::IndexedObjectPool;
   using xdecoder::Timer;
 
   const int count = 1e5;
@@ -50,6 +52,32 @@ int main(int argc, char* argv[]) {
     cache_pool.Delete(point);
   }
   std::cout << "timer 2 " << t2.Elapsed() << std::endl;
+
+  IndexedObjectPool<Point, 4> indexed_pool;
+  std::vector<uint32_t> indices;
+  for (int i = 0; i < 100; i++) {
+    uint32_t index = indexed_pool.New();
+    indexed_pool.Get(index)->x = i;
+    indices.push_back(index);
+  }
+  for (int i = 0; i < 100; i++) {
+    CHECK(indexed_pool.Get(indices[i])->x == i);
+  }
+  indexed_pool.Delete(indices[10]);
+  indexed_pool.Delete(indices[20]);
+  CHECK(indexed_pool.New() == indices[20]);
+  CHECK(indexed_pool.New() == indices[10]);
+  CHECK(indexed_pool.New() == 100);
+  Timer t3;
+  for (int i = 0; i < count; i++) {
+    uint32_t index = indexed_pool.New();
+    Point *point = indexed_pool.Get(index);
+    point->x = 1;
+    point->y = 2;
+    point->z = 3;
+    indexed_pool.Delete(index);
+  }
+  std::cout << "timer 3 " << t3.Elapsed() << std::endl;
   return 0;
 }
 
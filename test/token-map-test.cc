@@ -0,0 +1,168 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <map>  // for baseline.
+#include <vector>
+#include <iostream>
+
+#include "token-map.h"
+#include "hash-list.h"
+#include "timer.h"
+
+namespace xdecoder {
+
+// Same as TestHashList() in hash-list-test.cc
+template<class Int, class T> void TestTokenMap() {
+  typedef typename TokenMap<Int, T>::Elem Elem;
+  srand(time(NULL));
+  TokenMap<Int, T> hash;
+  hash.SetSize(200);
+  std::map<Int, T> m1;
+  for (size_t j = 0; j < 50; j++) {
+    Int key = rand() % 200;
+    T val = rand() % 50;
+    m1[key] = val;
+    Elem *e = hash.Find(key);
+    if (e) e->val = val;
+    else  hash.Insert(key, val);
+  }
+
+  std::map<Int, T> m2;
+  std::vector<Elem> last;
+  for (int i = 0; i < 100; i++) {
+    m2.clear();
+    for (typename std::map<Int, T>::const_iterator iter = m1.begin();
+        iter != m1.end();
+        iter++) {
+      m2[iter->first + 1] = iter->second;
+    }
+    std::swap(m1, m2);
+
+    hash.Clear(&last);
+    hash.SetSize(rand() % 200);  // may shrink as well as grow
+    for (size_t j = 0; j < last.size(); j++) {
+      hash.Insert(last[j].key + 1, last[j].val);
+    }
+
+    // Now make sure hash and m1 are the same.
+    const std::vector<Elem> &list = hash.GetList();
+    for (size_t j = 0; j < list.size(); j++) {
+      CHECK(m1[list[j].key] == list[j].val);
+    }
+
+    for (size_t j = 0; j < 10; j++) {
+      Int key = rand() % 200;
+      bool found_m1 = (m1.find(key) != m1.end());
+      Elem *e = hash.Find(key);
+      CHECK((e != NULL) == found_m1);
+      if (found_m1)
+        CHECK(m1[key] == e->val);
+    }
+
+    CHECK(m1.size() == list.size());
+  }
+}
+
+// A decoder like workload: in every frame, the first kNumActive keys of the
+// last frame expand to kNumArcs nearby keys each, which are found or
+// inserted. Returns the number of keys found.
+const int kNumFrames = 500, kNumActive = 5000, kNumArcs = 4,
+          kNumStates = 1000000, kNumOffsets = 4096;
+
+// random offsets of the expanded keys, shared by both benchmarks
+std::vector<int32_t> offsets;
+
+void InitOffsets() {
+  srand(0);
+  for (int i = 0; i < kNumOffsets; i++) {
+    offsets.push_back(rand() % 1024);
+  }
+}
+
+size_t BenchmarkHashList() {
+  typedef HashList<int32_t, uint32_t>::Elem Elem;
+  HashList<int32_t, uint32_t> hash;
+  hash.SetSize(kNumActive * kNumArcs * 2);
+  hash.Insert(0, 0);
+  size_t num_found = 0, k = 0;
+  for (int t = 0; t < kNumFrames; t++) {
+    Elem *h = hash.Clear(), *tmp;
+    for (int n = 0; h != NULL; h = tmp, n++) {
+      if (n < kNumActive) {
+        for (int a = 0; a < kNumArcs; a++) {
+          int32_t key = (h->key + offsets[k++ % kNumOffsets]) % kNumStates;
+          if (hash.Find(key) == NULL) hash.Insert(key, h->val);
+          else num_found++;
+        }
+      }
+      tmp = h->tail;
+      hash.Delete(h);
+    }
+  }
+  Elem *h = hash.Clear(), *tmp;
+  for (; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
+  return num_found;
+}
+
+size_t BenchmarkTokenMap() {
+  typedef TokenMap<int32_t, uint32_t>::Elem Elem;
+  TokenMap<int32_t, uint32_t> hash;
+  hash.SetSize(kNumActive * kNumArcs * 2);
+  hash.Insert(0, 0);
+  std::vector<Elem> last;
+  size_t num_found = 0, k = 0;
+  for (int t = 0; t < kNumFrames; t++) {
+    hash.Clear(&last);
+    for (int n = 0; n < static_cast<int>(last.size()); n++) {
+      if (n < kNumActive) {
+        for (int a = 0; a < kNumArcs; a++) {
+          int32_t key = (last[n].key + offsets[k++ % kNumOffsets]) % kNumStates;
+          if (hash.Find(key) == NULL) hash.Insert(key, last[n].val);
+          else num_found++;
+        }
+      }
+    }
+  }
+  return num_found;
+}
+
+}  // namespace xdecoder
+
+int main() {
+  for (size_t i = 0; i < 3; i++) {
+    xdecoder::TestTokenMap<int, unsigned int>();
+    xdecoder::TestTokenMap<unsigned int, int>();
+    xdecoder::TestTokenMap<int16_t, int32_t>();
+    xdecoder::TestTokenMap<char, unsigned char>();
+    xdecoder::TestTokenMap<unsigned char, int>();
+  }
+  std::cout << "Test OK.\n";
+
+  xdecoder::InitOffsets();
+  xdecoder::Timer t1;
+  size_t found1 = xdecoder::BenchmarkHashList();
+  std::cout << "HashList time " << t1.Elapsed() << std::endl;
+  xdecoder::Timer t2;
+  size_t found2 = xdecoder::BenchmarkTokenMap();
+  std::cout << "TokenMap time " << t2.Elapsed() << std::endl;
+  // same workload, same result
+  CHECK(found1 == found2);
+}
@@ -39,5 +39,21 @@ int main() {
   CHECK(Varint::ReadInt32(is) == 65536);
   CHECK(Varint::ReadInt32(is) == 2147483647);
   CHECK(Varint::ReadInt32(is) == -1);
+
+  uint8_t buffer[4 * xdecoder::kMaxVarint32Bytes];
+  uint8_t *end = buffer;
+  end = Varint::WriteVarint32ToArray(0, end);
+  end = Varint::WriteVarint32ToArray(300, end);
+  end = Varint::WriteVarint32ToArray(4294967295u, end);
+  CHECK(end - buffer == 1 + 2 + 5);
+  uint32_t value = 0;
+  const uint8_t *p = buffer;
+  p = Varint::ReadUint32FromArray(p, &value);
+  CHECK(value == 0);
+  p = Varint::ReadUint32FromArray(p, &value);
+  CHECK(value == 300);
+  p = Varint::ReadUint32FromArray(p, &value);
+  CHECK(value == 4294967295u);
+  CHECK(p == end);
   return 0;
 }
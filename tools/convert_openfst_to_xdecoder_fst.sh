@@ -8,8 +8,7 @@ fi
 hclg=$1
 xdecoder_fst=$2
 
-openfst_txt_tempfile=$(mktemp /tmp/fst.XXXXXX)
-fstprint $hclg > $openfst_txt_tempfile
-./tools/fst-init $openfst_txt_tempfile $xdecoder_fst
+# fst-init reads the openfst binary fst directly
+./tools/fst-init $hclg $xdecoder_fst
 
 
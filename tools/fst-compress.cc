@@ -0,0 +1,47 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+
+#include "fst.h"
+#include "compressed-fst.h"
+
+int main(int argc, char* argv[]) {
+  using xdecoder::Fst;
+  using xdecoder::CompressedFst;
+  const char *usage = "Compress fst, xdecode reads either of them\n"
+                      "Usage: fst-compress in-fst-file out-fst-file\n"
+                      "eg: fst-compress hclg hclg.compressed\n";
+
+  if (argc != 3) {
+    printf("%s", usage);
+    return -1;
+  }
+
+  Fst fst(argv[1]);
+  CompressedFst compressed_fst;
+  compressed_fst.Init(fst);
+  compressed_fst.Write(argv[2]);
+
+  // arcs, arc offsets and epsilon arc counts
+  int64_t arc_bytes =
+      sizeof(xdecoder::Arc) * static_cast<int64_t>(fst.NumArcs()) +
+      2 * sizeof(int32_t) * static_cast<int64_t>(fst.NumStates());
+  printf("num_states %d num_arcs %d\n", fst.NumStates(), fst.NumArcs());
+  printf("arc bytes: fst %ld compressed %ld, %.2f bytes per arc\n",
+         arc_bytes, compressed_fst.ArcBytes(),
+         static_cast<float>(compressed_fst.ArcBytes()) / fst.NumArcs());
+  return 0;
+}
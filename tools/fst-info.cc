@@ -14,22 +14,274 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "fst.h"
+#include "faster-decoder.h"
+#include "parse-option.h"
+
+using xdecoder::Arc;
+using xdecoder::ArcRange;
+using xdecoder::Fst;
+
+// Histogram of values in power of 2 buckets: 0, 1, 2, 3-4, 5-8, ...
+class Histogram {
+ public:
+  Histogram(): max_(0), sum_(0), count_(0) {}
+  void Add(int64_t value) {
+    size_t bucket = 0;
+    while (value > (1LL << bucket) / 2) bucket++;
+    if (bucket >= counts_.size()) counts_.resize(bucket + 1, 0);
+    counts_[bucket]++;
+    max_ = std::max(max_, value);
+    sum_ += value;
+    count_++;
+  }
+  void Print(const char *name) const {
+    printf("%s: mean %.2f max %ld\n", name,
+           count_ > 0 ? static_cast<double>(sum_) / count_ : 0.0, max_);
+    for (size_t i = 0; i < counts_.size(); i++) {
+      if (counts_[i] == 0) continue;
+      int64_t low = (1LL << i) / 4 + 1, high = (1LL << i) / 2;
+      if (i == 0) low = high = 0;
+      if (low == high) {
+        printf("  %8ld         %8ld %6.2f%%\n", low, counts_[i],
+               100.0 * counts_[i] / count_);
+      } else {
+        printf("  %8ld-%-8ld%8ld %6.2f%%\n", low, high, counts_[i],
+               100.0 * counts_[i] / count_);
+      }
+    }
+  }
+ private:
+  std::vector<int64_t> counts_;
+  int64_t max_, sum_, count_;
+};
+
+static void PrintBasic(const Fst& fst) {
+  int64_t num_eps_arcs = 0;
+  for (int32_t s = 0; s < fst.NumStates(); s++) {
+    num_eps_arcs += fst.NumEpsArcs(s);
+  }
+  printf("start state: %d\n", fst.Start());
+  printf("num states: %d\n", fst.NumStates());
+  printf("num arcs: %d\n", fst.NumArcs());
+  printf("num epsilon arcs: %ld\n", num_eps_arcs);
+  printf("num final states: %d\n", fst.NumFinals());
+
+  int64_t states_bytes = sizeof(int32_t) * static_cast<int64_t>(
+      fst.NumStates());
+  printf("memory: arcs %.2fMB, arc offsets %.2fMB, epsilon arc counts "
+         "%.2fMB, finals %.2fMB\n",
+         sizeof(Arc) * static_cast<double>(fst.NumArcs()) / 1048576,
+         states_bytes / 1048576.0, states_bytes / 1048576.0,
+         states_bytes / 1048576.0);
+}
+
+static void PrintDegrees(const Fst& fst) {
+  Histogram degrees, eps_degrees;
+  for (int32_t s = 0; s < fst.NumStates(); s++) {
+    degrees.Add(fst.NumArcs(s));
+    eps_degrees.Add(fst.NumEpsArcs(s));
+  }
+  degrees.Print("out degree");
+  eps_degrees.Print("epsilon out degree");
+}
+
+// Size of the epsilon closure of every state, not counting the state
+// itself, which ProcessNonemitting() expands after every frame
+static void PrintEpsClosures(const Fst& fst) {
+  Histogram closures;
+  std::vector<int32_t> stamps(fst.NumStates(), -1);
+  std::vector<int32_t> queue;
+  for (int32_t s = 0; s < fst.NumStates(); s++) {
+    int64_t size = 0;
+    stamps[s] = s;
+    queue.assign(1, s);
+    while (!queue.empty()) {
+      int32_t state = queue.back();
+      queue.pop_back();
+      ArcRange arcs = fst.EpsArcs(state);
+      for (const Arc *arc = arcs.begin(); arc != arcs.end(); arc++) {
+        if (stamps[arc->next_state] != s) {
+          stamps[arc->next_state] = s;
+          queue.push_back(arc->next_state);
+          size++;
+        }
+      }
+    }
+    closures.Add(size);
+  }
+  closures.Print("epsilon closure size");
+}
+
+// Epsilon cycles, by the strongly connected components of the epsilon arcs
+// (iterative Tarjan), a component of more than one state or a state with
+// an epsilon self loop is a cycle
+static void PrintEpsCycles(const Fst& fst) {
+  int32_t num_states = fst.NumStates();
+  std::vector<int32_t> index(num_states, -1), low(num_states, 0);
+  std::vector<bool> on_stack(num_states, false);
+  std::vector<int32_t> stack;
+  // (state, next arc to visit) of the dfs
+  std::vector<std::pair<int32_t, const Arc *> > dfs;
+  int32_t next_index = 0, num_cycles = 0, num_cycle_states = 0,
+          max_cycle = 0, num_self_loops = 0;
+  for (int32_t root = 0; root < num_states; root++) {
+    if (index[root] != -1) continue;
+    dfs.push_back(std::make_pair(root, fst.EpsArcs(root).begin()));
+    index[root] = low[root] = next_index++;
+    stack.push_back(root);
+    on_stack[root] = true;
+    while (!dfs.empty()) {
+      int32_t s = dfs.back().first;
+      const Arc *&arc = dfs.back().second;
+      if (arc != fst.EpsArcs(s).end()) {
+        int32_t next = arc->next_state;
+        arc++;
+        if (next == s) num_self_loops++;
+        if (index[next] == -1) {
+          index[next] = low[next] = next_index++;
+          stack.push_back(next);
+          on_stack[next] = true;
+          dfs.push_back(std::make_pair(next, fst.EpsArcs(next).begin()));
+        } else if (on_stack[next]) {
+          low[s] = std::min(low[s], index[next]);
+        }
+        continue;
+      }
+      dfs.pop_back();
+      if (!dfs.empty()) {
+        int32_t parent = dfs.back().first;
+        low[parent] = std::min(low[parent], low[s]);
+      }
+      if (low[s] == index[s]) {
+        int32_t size = 0, state;
+        do {
+          state = stack.back();
+          stack.pop_back();
+          on_stack[state] = false;
+          size++;
+        } while (state != s);
+        if (size > 1) {
+          num_cycles++;
+          num_cycle_states += size;
+          max_cycle = std::max(max_cycle, size);
+        }
+      }
+    }
+  }
+  printf("epsilon cycles: %d, states in them %d, largest %d, "
+         "epsilon self loops %d\n", num_cycles, num_cycle_states, max_cycle,
+         num_self_loops);
+}
+
+template <class T>
+static bool CountGreater(const std::pair<int64_t, T>& a,
+                         const std::pair<int64_t, T>& b) {
+  return a.first > b.first;
+}
+
+// Hottest states and arcs of a decode trace, see xdecode --trace-file
+static void PrintHotSpots(const Fst& fst, const xdecoder::DecodeTrace& trace,
+                          int32_t top) {
+  CHECK(static_cast<int32_t>(trace.state_counts.size()) <= fst.NumStates());
+  CHECK(static_cast<int32_t>(trace.arc_counts.size()) <= fst.NumArcs());
+  std::vector<std::pair<int64_t, int32_t> > states, arcs;
+  int64_t total = 0, num_visited = 0;
+  for (size_t i = 0; i < trace.state_counts.size(); i++) {
+    if (trace.state_counts[i] == 0) continue;
+    states.push_back(std::make_pair(trace.state_counts[i], i));
+    total += trace.state_counts[i];
+    num_visited++;
+  }
+  for (size_t i = 0; i < trace.arc_counts.size(); i++) {
+    if (trace.arc_counts[i] > 0)
+      arcs.push_back(std::make_pair(trace.arc_counts[i], i));
+  }
+  std::sort(states.begin(), states.end(), CountGreater<int32_t>);
+  std::sort(arcs.begin(), arcs.end(), CountGreater<int32_t>);
+
+  printf("trace: %ld active tokens, %ld of %d states visited, "
+         "%zu of %d arcs\n", total, num_visited, fst.NumStates(),
+         arcs.size(), fst.NumArcs());
+  // How concentrated the search is
+  int64_t sum = 0;
+  for (size_t i = 0, next = 1; i < states.size(); i++) {
+    sum += states[i].first;
+    if (i + 1 == next || i + 1 == states.size()) {
+      printf("  hottest %zu states: %.2f%% of active tokens\n", i + 1,
+             100.0 * sum / total);
+      next *= 10;
+    }
+  }
+  printf("hottest states (state count arcs epsilon_arcs):\n");
+  for (size_t i = 0; i < states.size() && i < static_cast<size_t>(top);
+       i++) {
+    int32_t s = states[i].second;
+    printf("  %d %ld %d %d\n", s, states[i].first, fst.NumArcs(s),
+           fst.NumEpsArcs(s));
+  }
+  printf("hottest arcs (src next_state ilabel olabel weight count):\n");
+  for (size_t i = 0; i < arcs.size() && i < static_cast<size_t>(top); i++) {
+    // the source state, the last state whose first arc is not after it
+    int32_t index = arcs[i].second, low = 0, high = fst.NumStates() - 1;
+    while (low < high) {
+      int32_t mid = (low + high + 1) / 2;
+      if (fst.ArcIndex(fst.ArcStart(mid)) <= index) {
+        low = mid;
+      } else {
+        high = mid - 1;
+      }
+    }
+    const Arc& arc = fst.GetArc(index);
+    printf("  %d %d %d %d %f %ld\n", low, arc.next_state, arc.ilabel,
+           arc.olabel, arc.weight, arcs[i].first);
+  }
+}
 
 int main(int argc, char* argv[]) {
-  using xdecoder::Fst;
-  const char *usage = "Showing details text information of fsm format file\n"
-                      "Usage: fst-info fst-file]\n"
-                      "eg: fst-info in.fst\n";
+  using xdecoder::ParseOptions;
+  using xdecoder::DecodeTrace;
+  const char *usage = "Showing statistics of fsm format file: degrees, "
+                      "epsilon closures and cycles,\n"
+                      "memory, and the hot spots of a decode trace\n"
+                      "Usage: fst-info [options] fst-file\n"
+                      "eg: fst-info in.fst\n"
+                      "    fst-info --trace-file=trace.txt in.fst\n";
 
-  if (argc != 2) {
-    printf("%s", usage);
-    return -1;
+  ParseOptions option(usage);
+  std::string trace_file = "";
+  option.Register("trace-file", &trace_file,
+                  "decode trace written by xdecode --trace-file");
+  int top = 20;
+  option.Register("top", &top, "number of hottest states and arcs shown");
+  bool print = false;
+  option.Register("print", &print, "print all the states and arcs");
+  option.Read(argc, argv);
+  if (option.NumArgs() != 1) {
+    option.PrintUsage();
+    exit(1);
   }
 
-  Fst fst(argv[1]);
-  fst.Info();
+  Fst fst(option.GetArg(1));
+  if (print) {
+    fst.Info();
+    return 0;
+  }
+  PrintBasic(fst);
+  PrintDegrees(fst);
+  PrintEpsClosures(fst);
+  PrintEpsCycles(fst);
+  if (trace_file != "") {
+    DecodeTrace trace;
+    trace.Read(trace_file);
+    PrintHotSpots(fst, trace, top);
+  }
   return 0;
 }
-
@@ -22,15 +22,19 @@ int main(int argc, char *argv[]) {
   using xdecoder::Fst;
   using xdecoder::SymbolTable;
   using xdecoder::ParseOptions;
-  const char *usage = "Init fst from topo file, like the way openfst compile"
+  const char *usage = "Init fst from topo file, like the way openfst compile,"
+                      " or from openfst binary fst\n"
                       "Usage: aslp-fst-init topo_file out_file\n"
-                      "eg: aslp-fst-init topo_file out.fst\n";
+                      "eg: aslp-fst-init topo_file out.fst\n"
+                      "    aslp-fst-init HCLG.fst out.fst\n";
 
   ParseOptions po(usage);
   std::string isymbols = "";
   po.Register("isymbols", &isymbols, "input symbol file");
   std::string osymbols = "";
   po.Register("osymbols", &osymbols, "output symbol file");
+  int num_threads = 1;
+  po.Register("num-threads", &num_threads, "threads to parse topo file");
 
   po.Read(argc, argv);
 
@@ -43,11 +47,13 @@ int main(int argc, char *argv[]) {
               out_file = po.GetArg(2);
 
   Fst fst;
-  if (isymbols == "" || osymbols == "") {
-    fst.ReadTopo(topo_file);
+  if (Fst::IsOpenFst(topo_file)) {
+    fst.ReadOpenFst(topo_file);
+  } else if (isymbols == "" || osymbols == "") {
+    fst.ReadTopo(topo_file, num_threads);
   } else {
     SymbolTable isymbol_table(isymbols), osymbol_table(osymbols);
-    fst.ReadTopo(topo_file, isymbol_table, osymbol_table);
+    fst.ReadTopo(topo_file, isymbol_table, osymbol_table, num_threads);
   }
   fst.Write(out_file);
   return 0;
@@ -0,0 +1,272 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <deque>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fst.h"
+#include "parse-option.h"
+
+using xdecoder::Arc;
+using xdecoder::kNonFinalWeight;
+
+// The graph being optimized, arcs and final weight of every state
+struct Graph {
+  int32_t start;
+  std::vector<std::vector<Arc> > arcs;
+  std::vector<float> finals;
+};
+
+static void PrintStats(const char *name, const Graph& graph) {
+  int64_t num_arcs = 0, num_eps_arcs = 0;
+  for (size_t s = 0; s < graph.arcs.size(); s++) {
+    num_arcs += graph.arcs[s].size();
+    for (size_t i = 0; i < graph.arcs[s].size(); i++) {
+      if (graph.arcs[s][i].ilabel == 0) num_eps_arcs++;
+    }
+  }
+  printf("%-12s num_states %zu num_arcs %ld num_eps_arcs %ld\n", name,
+         graph.arcs.size(), num_arcs, num_eps_arcs);
+}
+
+// Keeps the states on some path from the start state to a final state
+static void Connect(Graph *graph) {
+  int32_t num_states = graph->arcs.size();
+  std::vector<std::vector<int32_t> > prev_states(num_states);
+  for (int32_t s = 0; s < num_states; s++) {
+    for (size_t i = 0; i < graph->arcs[s].size(); i++) {
+      prev_states[graph->arcs[s][i].next_state].push_back(s);
+    }
+  }
+  // accessible, from the start state
+  std::vector<bool> access(num_states, false);
+  std::deque<int32_t> queue;
+  access[graph->start] = true;
+  queue.push_back(graph->start);
+  while (!queue.empty()) {
+    int32_t s = queue.front();
+    queue.pop_front();
+    for (size_t i = 0; i < graph->arcs[s].size(); i++) {
+      int32_t next = graph->arcs[s][i].next_state;
+      if (!access[next]) {
+        access[next] = true;
+        queue.push_back(next);
+      }
+    }
+  }
+  // coaccessible, to any final state
+  std::vector<bool> coaccess(num_states, false);
+  for (int32_t s = 0; s < num_states; s++) {
+    if (graph->finals[s] != kNonFinalWeight) {
+      coaccess[s] = true;
+      queue.push_back(s);
+    }
+  }
+  while (!queue.empty()) {
+    int32_t s = queue.front();
+    queue.pop_front();
+    for (size_t i = 0; i < prev_states[s].size(); i++) {
+      int32_t prev = prev_states[s][i];
+      if (!coaccess[prev]) {
+        coaccess[prev] = true;
+        queue.push_back(prev);
+      }
+    }
+  }
+  if (!coaccess[graph->start]) {
+    ERROR("no final state can be reached from the start state");
+  }
+
+  std::vector<int32_t> new_ids(num_states, -1);
+  int32_t num_new_states = 0;
+  for (int32_t s = 0; s < num_states; s++) {
+    if (access[s] && coaccess[s]) new_ids[s] = num_new_states++;
+  }
+  for (int32_t s = 0; s < num_states; s++) {
+    int32_t id = new_ids[s];
+    if (id < 0) continue;
+    std::vector<Arc> arcs;
+    for (size_t i = 0; i < graph->arcs[s].size(); i++) {
+      Arc arc = graph->arcs[s][i];
+      if (new_ids[arc.next_state] < 0) continue;
+      arc.next_state = new_ids[arc.next_state];
+      arcs.push_back(arc);
+    }
+    // id <= s, so state s is not overwritten before it is read
+    graph->arcs[id].swap(arcs);
+    graph->finals[id] = graph->finals[s];
+  }
+  graph->arcs.resize(num_new_states);
+  graph->finals.resize(num_new_states);
+  graph->start = new_ids[graph->start];
+}
+
+// A state which only passes on to another state by its epsilon arc
+static const Arc *OnlyEpsArc(const Graph& graph, int32_t s) {
+  const std::vector<Arc>& arcs = graph.arcs[s];
+  if (s == graph.start || graph.finals[s] != kNonFinalWeight ||
+      arcs.size() != 1 || arcs[0].ilabel != 0 || arcs[0].next_state == s) {
+    return NULL;
+  }
+  return &arcs[0];
+}
+
+// Redirects the arcs entering a state of OnlyEpsArc() to the state after
+// it, it's safe for that the state does nothing else. The arcs keep at
+// most one olabel, so chains with two olabels are kept.
+static void BypassEpsChains(Graph *graph) {
+  int32_t num_states = graph->arcs.size();
+  int64_t num_bypassed = 0;
+  for (int32_t s = 0; s < num_states; s++) {
+    for (size_t i = 0; i < graph->arcs[s].size(); i++) {
+      Arc &arc = graph->arcs[s][i];
+      // bounded, in case of a cycle of such states
+      for (int32_t n = 0; n < num_states; n++) {
+        const Arc *eps = OnlyEpsArc(*graph, arc.next_state);
+        if (eps == NULL || (arc.olabel != 0 && eps->olabel != 0)) break;
+        if (eps->olabel != 0) arc.olabel = eps->olabel;
+        arc.weight += eps->weight;
+        arc.next_state = eps->next_state;
+        num_bypassed++;
+      }
+    }
+  }
+  printf("bypassed %ld epsilon arcs\n", num_bypassed);
+}
+
+// Pushes the weights toward the start state in the tropical semiring, then
+// the weight of an arc also tells the best cost to finish from it, and the
+// beam prunes the hopeless paths earlier. Every complete path changes by
+// the same cost, the distance of the start state, so the best path is the
+// same. Returns false if the graph has a negative cycle.
+static bool PushWeights(Graph *graph) {
+  int32_t num_states = graph->arcs.size();
+  const double infinity = std::numeric_limits<double>::infinity();
+  std::vector<std::vector<std::pair<int32_t, float> > > prev_arcs(num_states);
+  for (int32_t s = 0; s < num_states; s++) {
+    for (size_t i = 0; i < graph->arcs[s].size(); i++) {
+      const Arc &arc = graph->arcs[s][i];
+      prev_arcs[arc.next_state].push_back(std::make_pair(s, arc.weight));
+    }
+  }
+  // shortest distance to a final state, by Bellman-Ford with a queue
+  std::vector<double> distance(num_states, infinity);
+  std::vector<bool> in_queue(num_states, false);
+  std::vector<int32_t> num_updates(num_states, 0);
+  std::deque<int32_t> queue;
+  for (int32_t s = 0; s < num_states; s++) {
+    if (graph->finals[s] != kNonFinalWeight) {
+      distance[s] = graph->finals[s];
+      in_queue[s] = true;
+      queue.push_back(s);
+    }
+  }
+  const double kDelta = 1e-6;
+  while (!queue.empty()) {
+    int32_t s = queue.front();
+    queue.pop_front();
+    in_queue[s] = false;
+    for (size_t i = 0; i < prev_arcs[s].size(); i++) {
+      int32_t prev = prev_arcs[s][i].first;
+      double d = distance[s] + prev_arcs[s][i].second;
+      if (d < distance[prev] - kDelta) {
+        distance[prev] = d;
+        if (++num_updates[prev] > num_states) return false;
+        if (!in_queue[prev]) {
+          in_queue[prev] = true;
+          queue.push_back(prev);
+        }
+      }
+    }
+  }
+
+  for (int32_t s = 0; s < num_states; s++) {
+    for (size_t i = 0; i < graph->arcs[s].size(); i++) {
+      Arc &arc = graph->arcs[s][i];
+      arc.weight += distance[arc.next_state] - distance[s];
+    }
+    if (graph->finals[s] != kNonFinalWeight) {
+      graph->finals[s] -= distance[s];
+    }
+  }
+  printf("pushed weights, cost of every path reduced by %f\n",
+         distance[graph->start]);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  using xdecoder::Fst;
+  using xdecoder::ParseOptions;
+  const char *usage = "Optimize fst for decoding, remove the states not on "
+                      "any successful path, bypass\n"
+                      "epsilon chains and push weights toward the start "
+                      "state. Compare the graphs by\n"
+                      "the active tokens and RTF xdecode reports\n"
+                      "Usage: fst-optimize [options] in-fst-file "
+                      "out-fst-file\n"
+                      "eg: fst-optimize hclg hclg.opt\n";
+
+  ParseOptions option(usage);
+  bool remove_eps = true;
+  option.Register("remove-eps", &remove_eps, "bypass epsilon chains");
+  bool push_weights = true;
+  option.Register("push-weights", &push_weights,
+                  "push weights toward the start state");
+  option.Read(argc, argv);
+  if (option.NumArgs() != 2) {
+    option.PrintUsage();
+    exit(1);
+  }
+
+  Graph graph;
+  {
+    Fst fst(option.GetArg(1));
+    graph.start = fst.Start();
+    graph.arcs.resize(fst.NumStates());
+    graph.finals.resize(fst.NumStates());
+    for (int32_t s = 0; s < fst.NumStates(); s++) {
+      graph.arcs[s].assign(fst.ArcStart(s), fst.ArcEnd(s));
+      graph.finals[s] = fst.Final(s);
+    }
+  }
+  CHECK(graph.arcs.size() > 0);
+  PrintStats("input", graph);
+  Connect(&graph);
+  PrintStats("connect", graph);
+  if (remove_eps) {
+    BypassEpsChains(&graph);
+    Connect(&graph);
+    PrintStats("remove-eps", graph);
+  }
+  if (push_weights && !PushWeights(&graph)) {
+    LOG("negative cycle in the graph, weights are not pushed");
+  }
+
+  std::map<int32_t, float> finals;
+  for (size_t s = 0; s < graph.finals.size(); s++) {
+    if (graph.finals[s] != kNonFinalWeight) finals[s] = graph.finals[s];
+  }
+  Fst fst;
+  fst.SetStart(graph.start);
+  fst.Init(&graph.arcs, finals);
+  fst.Write(option.GetArg(2));
+  return 0;
+}
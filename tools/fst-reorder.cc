@@ -0,0 +1,161 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fst.h"
+#include "faster-decoder.h"
+#include "parse-option.h"
+
+// Mean distance between a state and the next states of its arcs, the
+// smaller it is, the more likely the states expanded together are close
+// in memory
+static double MeanArcDistance(const xdecoder::Fst& fst) {
+  double sum = 0.0;
+  for (int32_t i = 0; i < fst.NumStates(); i++) {
+    for (const xdecoder::Arc *arc = fst.ArcStart(i);
+         arc != fst.ArcEnd(i); arc++) {
+      sum += abs(arc->next_state - i);
+    }
+  }
+  return fst.NumArcs() > 0 ? sum / fst.NumArcs() : 0.0;
+}
+
+// BFS or DFS order of the states from the start state, the states which
+// are not reachable go last
+static void StateOrder(const xdecoder::Fst& fst, bool bfs,
+                       std::vector<int32_t> *new_ids) {
+  using xdecoder::Arc;
+  int32_t num_states = fst.NumStates();
+  new_ids->assign(num_states, -1);
+  int32_t next_id = 0;
+  std::deque<int32_t> states;
+  if (num_states > 0) states.push_back(fst.Start());
+  while (!states.empty()) {
+    int32_t state;
+    if (bfs) {
+      state = states.front();
+      states.pop_front();
+    } else {
+      state = states.back();
+      states.pop_back();
+    }
+    if ((*new_ids)[state] != -1) continue;
+    (*new_ids)[state] = next_id++;
+    if (bfs) {
+      for (const Arc *arc = fst.ArcStart(state); arc != fst.ArcEnd(state);
+           arc++) {
+        if ((*new_ids)[arc->next_state] == -1)
+          states.push_back(arc->next_state);
+      }
+    } else {
+      // reversed, so the first arc is visited first
+      for (const Arc *arc = fst.ArcEnd(state); arc != fst.ArcStart(state);
+           arc--) {
+        if ((*new_ids)[(arc - 1)->next_state] == -1)
+          states.push_back((arc - 1)->next_state);
+      }
+    }
+  }
+  for (int32_t i = 0; i < num_states; i++) {
+    if ((*new_ids)[i] == -1) (*new_ids)[i] = next_id++;
+  }
+}
+
+// Moves the states active in the trace first, the hottest first, the other
+// states keep their relative order in new_ids
+static void HotStatesFirst(const xdecoder::DecodeTrace& trace,
+                           std::vector<int32_t> *new_ids) {
+  const std::vector<int64_t>& counts = trace.state_counts;
+  int32_t num_states = static_cast<int32_t>(new_ids->size());
+  if (static_cast<int32_t>(counts.size()) > num_states) {
+    ERROR("trace has state %d, but the fst has %d states only",
+          static_cast<int32_t>(counts.size()) - 1, num_states);
+  }
+  // (-count, state), so the hottest go first, by state id on equal counts
+  std::vector<std::pair<int64_t, int32_t> > hot_states;
+  for (int32_t i = 0; i < static_cast<int32_t>(counts.size()); i++) {
+    if (counts[i] > 0) hot_states.push_back(std::make_pair(-counts[i], i));
+  }
+  std::sort(hot_states.begin(), hot_states.end());
+  // the other states by their current new id
+  std::vector<int32_t> old_ids(num_states);
+  for (int32_t i = 0; i < num_states; i++) old_ids[(*new_ids)[i]] = i;
+  int32_t next_id = 0;
+  for (size_t i = 0; i < hot_states.size(); i++) {
+    (*new_ids)[hot_states[i].second] = next_id++;
+  }
+  for (int32_t i = 0; i < num_states; i++) {
+    int32_t state = old_ids[i];
+    if (state >= static_cast<int32_t>(counts.size()) || counts[state] == 0)
+      (*new_ids)[state] = next_id++;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  using xdecoder::Fst;
+  using xdecoder::ParseOptions;
+  const char *usage = "Renumber the states of fst in BFS or DFS order from "
+                      "the start state, so the states\n"
+                      "expanded together are stored close to each other,\n"
+                      "with --trace-file the states active in the trace go "
+                      "first, the hottest first\n"
+                      "Usage: fst-reorder [options] in-fst-file "
+                      "out-fst-file\n"
+                      "eg: fst-reorder --order=dfs hclg hclg.reorder\n"
+                      "    fst-reorder --trace-file=trace.txt hclg "
+                      "hclg.reorder\n";
+
+  ParseOptions option(usage);
+  std::string order = "dfs";
+  option.Register("order", &order, "state order, bfs or dfs");
+  std::string trace_file = "";
+  option.Register("trace-file", &trace_file,
+                  "decode trace of in-fst-file by xdecode --trace-file, "
+                  "its active states go first by count, the others follow "
+                  "in --order");
+  option.Read(argc, argv);
+  if (option.NumArgs() != 2) {
+    option.PrintUsage();
+    exit(1);
+  }
+  if (order != "bfs" && order != "dfs") {
+    ERROR("unknown order %s, bfs or dfs expected", order.c_str());
+  }
+
+  Fst fst(option.GetArg(1));
+  std::vector<int32_t> new_ids;
+  StateOrder(fst, order == "bfs", &new_ids);
+  if (trace_file != "") {
+    xdecoder::DecodeTrace trace;
+    trace.Read(trace_file);
+    HotStatesFirst(trace, &new_ids);
+  }
+
+  double before = MeanArcDistance(fst);
+  fst.Renumber(new_ids);
+  fst.Write(option.GetArg(2));
+  printf("num_states %d num_arcs %d\n", fst.NumStates(), fst.NumArcs());
+  printf("mean arc distance %.2f -> %.2f states\n", before,
+         MeanArcDistance(fst));
+  return 0;
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2026 Personal (Binbin Zhang)
+// Created on 2026-10-17
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "net.h"
+#include "parse-option.h"
+#include "timer.h"
+
+// Average seconds of one Net::Forward of a batch of batch_size frames
+static double ForwardLatency(const xdecoder::Net& net, int batch_size,
+                             int num_iters, bool fresh_workspace) {
+  using xdecoder::Matrix;
+  using xdecoder::NetWorkspace;
+  Matrix<float> in(batch_size, net.InDim()), out;
+  for (int i = 0; i < in.Size(); i++) {
+    in.Data()[i] = static_cast<float>(rand()) / RAND_MAX * 2 - 1;
+  }
+  NetWorkspace workspace;
+  net.Forward(in, &out, &workspace);  // warm up
+  xdecoder::Timer timer;
+  for (int i = 0; i < num_iters; i++) {
+    if (fresh_workspace) {
+      NetWorkspace local_workspace;
+      net.Forward(in, &out, &local_workspace);
+    } else {
+      net.Forward(in, &out, &workspace);
+    }
+  }
+  return timer.Elapsed() / num_iters;
+}
+
+int main(int argc, char *argv[]) {
+  using xdecoder::ParseOptions;
+  using xdecoder::Net;
+  const char *usage = "Report the forward latency of the float net and its "
+                      "quantized net for batch sizes\n"
+                      "from 1 to max-batch-size, in powers of 2\n"
+                      "Usage: net-benchmark [options] float-net-file\n"
+                      "eg: net-benchmark --max-batch-size=64 am.net\n";
+  ParseOptions option(usage);
+  int max_batch_size = 64, num_iters = 100;
+  bool fresh_workspace = false, per_row = false;
+  option.Register("max-batch-size", &max_batch_size, "max batch size");
+  option.Register("num-iters", &num_iters, "forward times of every batch");
+  option.Register("fresh-workspace", &fresh_workspace,
+                  "forward with a new workspace every time, like a new "
+                  "gemm context per call");
+  option.Register("per-row", &per_row,
+                  "benchmark the per-row int8 net instead of the uint8 one");
+  option.Read(argc, argv);
+  if (option.NumArgs() != 1) {
+    option.PrintUsage();
+    exit(1);
+  }
+
+  Net net(option.GetArg(1)), quantize_net;
+  if (per_row) {
+    net.QuantizePerRow(&quantize_net);
+  } else {
+    net.Quantize(&quantize_net);
+  }
+  printf("%6s %12s %12s %10s\n", "batch", "float(ms)", "int8(ms)",
+         "speedup");
+  for (int batch_size = 1; batch_size <= max_batch_size; batch_size *= 2) {
+    double float_time = ForwardLatency(net, batch_size, num_iters,
+                                       fresh_workspace);
+    double int8_time = ForwardLatency(quantize_net, batch_size, num_iters,
+                                      fresh_workspace);
+    printf("%6d %12.3f %12.3f %10.2f\n", batch_size, float_time * 1000,
+           int8_time * 1000, float_time / int8_time);
+  }
+  return 0;
+}
@@ -13,16 +13,276 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
 
+#include "feature-pipeline.h"
 #include "net.h"
 #include "parse-option.h"
+#include "wav.h"
+
+using xdecoder::Matrix;
+using xdecoder::Net;
+using xdecoder::NetWorkspace;
+
+// The features of every wav of wav_scp, feats[i] is num_frames x dim
+static void ReadFeatures(
+    const xdecoder::FeaturePipelineConfig& feature_options,
+    const std::string& wav_scp_file, std::vector<std::string>* keys,
+    std::vector<std::vector<float> >* feats, int* dim) {
+  using xdecoder::FeaturePipeline;
+  using xdecoder::WavReader;
+  FILE *fin = fopen(wav_scp_file.c_str(), "r");
+  if (!fin) {
+    ERROR("%s not exint, please check!!!", wav_scp_file.c_str());
+  }
+  FeaturePipeline feature_pipeline(feature_options);
+  *dim = feature_pipeline.FeatureDim();
+  char buffer[1024] = {0}, key[1024] = {0}, path[1024] = {0};
+  int num_frames = 0;
+  while (fgets(buffer, 1024, fin)) {
+    int num = sscanf(buffer, "%s %s", key, path);
+    if (num != 2) {
+      ERROR("each line shoud have 2 fields, key & wav path");
+    }
+    WavReader wav_reader(path);
+    CHECK(wav_reader.NumChannel() == 1);
+    feature_pipeline.AcceptRawWav(std::vector<float>(wav_reader.Data(),
+        wav_reader.Data() + wav_reader.NumSample()));
+    feature_pipeline.SetDone();
+    std::vector<float> feat;
+    feature_pipeline.ReadAllFeature(&feat);
+    feature_pipeline.Reset();
+    if (feat.size() < static_cast<size_t>(*dim)) continue;
+    keys->push_back(key);
+    feats->push_back(feat);
+    num_frames += feat.size() / *dim;
+  }
+  fclose(fin);
+  if (num_frames == 0) ERROR("no frames in %s", wav_scp_file.c_str());
+  LOG("calibration set of %d wavs, %d frames",
+      static_cast<int>(feats->size()), num_frames);
+}
+
+// Records the min and max of the input of every layer of the float net
+static void Calibrate(const Net& net,
+                      const std::vector<std::vector<float> >& feats, int dim,
+                      std::vector<float>* in_min, std::vector<float>* in_max) {
+  NetWorkspace workspace;
+  for (size_t i = 0; i < feats.size(); i++) {
+    Matrix<float> in(const_cast<float *>(feats[i].data()),
+                     feats[i].size() / dim, dim);
+    net.UpdateInputRange(in, &workspace, in_min, in_max);
+  }
+}
+
+// Text alignments of the net output index (pdf id) of every frame,
+// "key pdf pdf ...", as the output of kaldi ali-to-pdf
+static void ReadAlignments(
+    const std::string& alignment_file,
+    std::map<std::string, std::vector<int32_t> >* alignments) {
+  std::ifstream is(alignment_file);
+  if (is.fail()) {
+    ERROR("read file %s error, check!!!", alignment_file.c_str());
+  }
+  std::string line;
+  while (std::getline(is, line)) {
+    std::istringstream ss(line);
+    std::string key;
+    if (!(ss >> key)) continue;
+    std::vector<int32_t>& ali = (*alignments)[key];
+    int32_t pdf;
+    while (ss >> pdf) ali.push_back(pdf);
+  }
+}
+
+// Output of net for all the features
+static void ForwardAll(const Net& net,
+                       const std::vector<std::vector<float> >& feats,
+                       int dim, std::vector<std::vector<float> >* outs) {
+  NetWorkspace workspace;
+  outs->resize(feats.size());
+  for (size_t i = 0; i < feats.size(); i++) {
+    Matrix<float> in(const_cast<float *>(feats[i].data()),
+                     feats[i].size() / dim, dim), out;
+    net.Forward(in, &out, &workspace);
+    (*outs)[i].assign(out.Data(), out.Data() + out.Size());
+  }
+}
+
+struct Evaluation {
+  // RMS of the output difference to the float net, relative to the RMS of
+  // the float net output
+  double divergence;
+  // frame accuracy against the alignments, -1 if there is none
+  double accuracy;
+};
+
+static Evaluation Evaluate(
+    const Net& net, const std::vector<std::vector<float> >& feats, int dim,
+    const std::vector<std::vector<float> >& float_outs,
+    const std::vector<const std::vector<int32_t>*>& alignments) {
+  std::vector<std::vector<float> > outs;
+  ForwardAll(net, feats, dim, &outs);
+  int out_dim = net.OutDim();
+  double diff = 0.0, norm = 0.0;
+  int64_t num_correct = 0, num_aligned = 0;
+  for (size_t i = 0; i < outs.size(); i++) {
+    for (size_t k = 0; k < outs[i].size(); k++) {
+      double d = outs[i][k] - float_outs[i][k];
+      diff += d * d;
+      norm += static_cast<double>(float_outs[i][k]) * float_outs[i][k];
+    }
+    if (alignments[i] == NULL) continue;
+    size_t num_frames = std::min(outs[i].size() / out_dim,
+                                 alignments[i]->size());
+    for (size_t t = 0; t < num_frames; t++) {
+      const float* frame = outs[i].data() + t * out_dim;
+      int32_t best = std::max_element(frame, frame + out_dim) - frame;
+      num_correct += best == (*alignments[i])[t];
+    }
+    num_aligned += num_frames;
+  }
+  Evaluation evaluation;
+  evaluation.divergence = norm > 0.0 ? sqrt(diff / norm) : sqrt(diff);
+  evaluation.accuracy = num_aligned > 0 ?
+      static_cast<double>(num_correct) / num_aligned : -1.0;
+  return evaluation;
+}
+
+static std::string AccuracyString(const Evaluation& evaluation) {
+  if (evaluation.accuracy < 0) return "";
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), " accuracy %.4f", evaluation.accuracy);
+  return buffer;
+}
+
+// Net with the layers of quantize set quantized, the others are copied
+static void QuantizeLayers(const Net& net, const std::vector<bool>& quantize,
+                           bool per_row, const std::vector<float>& in_min,
+                           const std::vector<float>& in_max,
+                           Net* quantize_net) {
+  quantize_net->Clear();
+  for (int32_t i = 0; i < net.NumLayers(); i++) {
+    const xdecoder::Layer* layer = net.GetLayer(i);
+    if (!quantize[i]) {
+      quantize_net->AddLayer(layer->Copy());
+    } else if (per_row) {
+      quantize_net->AddLayer(layer->QuantizePerRow());
+    } else {
+      quantize_net->AddLayer(layer->QuantizeWithRange(in_min[i], in_max[i]));
+    }
+  }
+}
+
+// Quantizes every FullyConnect alone to measure its sensitivity, then adds
+// them from the least sensitive per weight to the mixed net, as long as the
+// mixed net stays within max_divergence and max_accuracy_loss of the float
+// net. The sensitive layers are left in float.
+static void MixedQuantize(
+    const Net& net, const std::vector<std::vector<float> >& feats, int dim,
+    const std::vector<const std::vector<int32_t>*>& alignments,
+    bool per_row, const std::vector<float>& in_min,
+    const std::vector<float>& in_max, float max_divergence,
+    float max_accuracy_loss, Net* mixed_net) {
+  std::vector<std::vector<float> > float_outs;
+  ForwardAll(net, feats, dim, &float_outs);
+  Evaluation float_eval = Evaluate(net, feats, dim, float_outs, alignments);
+  if (float_eval.accuracy >= 0) {
+    LOG("float net frame accuracy %.4f", float_eval.accuracy);
+  }
+
+  int32_t num_layers = net.NumLayers();
+  std::vector<std::pair<double, int32_t> > order;
+  for (int32_t i = 0; i < num_layers; i++) {
+    const xdecoder::Layer* layer = net.GetLayer(i);
+    if (layer->Type() != xdecoder::kFullyConnect) continue;
+    std::vector<bool> quantize(num_layers, false);
+    quantize[i] = true;
+    Net trial;
+    QuantizeLayers(net, quantize, per_row, in_min, in_max, &trial);
+    Evaluation eval = Evaluate(trial, feats, dim, float_outs, alignments);
+    LOG("layer %d in_dim %d out_dim %d divergence %.5f%s", i,
+        layer->InDim(), layer->OutDim(), eval.divergence,
+        AccuracyString(eval).c_str());
+    double num_weights = static_cast<double>(layer->InDim()) *
+                         layer->OutDim();
+    order.push_back(std::make_pair(eval.divergence / num_weights, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<bool> quantize(num_layers, false);
+  for (size_t k = 0; k < order.size(); k++) {
+    int32_t i = order[k].second;
+    quantize[i] = true;
+    Net trial;
+    QuantizeLayers(net, quantize, per_row, in_min, in_max, &trial);
+    Evaluation eval = Evaluate(trial, feats, dim, float_outs, alignments);
+    bool ok = eval.divergence <= max_divergence &&
+              (float_eval.accuracy < 0 ||
+               float_eval.accuracy - eval.accuracy <= max_accuracy_loss);
+    LOG("%s layer %d, mixed net divergence %.5f%s",
+        ok ? "quantize" : "keep float", i, eval.divergence,
+        AccuracyString(eval).c_str());
+    if (!ok) quantize[i] = false;
+  }
+  QuantizeLayers(net, quantize, per_row, in_min, in_max, mixed_net);
+}
 
 int main(int argc, char *argv[]) {
   using xdecoder::ParseOptions;
-  using xdecoder::Net;
-  const char *usage = "Convert float net to quantize net\n";
+  const char *usage = "Convert float net to quantize net\n"
+                      "Usage: net-quantization [options] float-net-file "
+                      "quantize-net-file\n"
+                      "eg: net-quantization --calibration-scp=wav.scp "
+                      "--cmvn-file=am.cmvn am.net am.qnet\n"
+                      "    net-quantization --mixed --calibration-scp=wav.scp "
+                      "--cmvn-file=am.cmvn am.net am.mixed.net\n";
   ParseOptions option(usage);
+  xdecoder::FeaturePipelineConfig feature_options;
+  std::string calibration_scp = "";
+  option.Register("calibration-scp", &calibration_scp,
+                  "wav list to calibrate the input range of every layer, "
+                  "the layer inputs are then quantized by fixed params; "
+                  "by their own min and max if it is empty");
+  bool per_row = false;
+  option.Register("per-row", &per_row,
+                  "int8 weights with a scale per output row and int8 "
+                  "input quantized frame by frame, no calibration needed");
+  bool mixed = false;
+  option.Register("mixed", &mixed,
+                  "quantize only the layers which keep the net within "
+                  "--max-divergence and --max-accuracy-loss on the "
+                  "calibration set, the others stay float");
+  float max_divergence = 0.05;
+  option.Register("max-divergence", &max_divergence,
+                  "max RMS of the output difference to the float net, "
+                  "relative to the RMS of the float output, for --mixed");
+  std::string alignment_file = "";
+  option.Register("alignment-file", &alignment_file,
+                  "text pdf alignments of the calibration set, "
+                  "\"key pdf pdf ...\", to bound the frame accuracy loss "
+                  "for --mixed");
+  float max_accuracy_loss = 0.005;
+  option.Register("max-accuracy-loss", &max_accuracy_loss,
+                  "max frame accuracy loss to the float net, for --mixed "
+                  "with --alignment-file");
+  option.Register("num-bins", &feature_options.num_bins,
+                  "Fbank dimension");
+  option.Register("left-context", &feature_options.left_context,
+                  "feature left context");
+  option.Register("right-context", &feature_options.right_context,
+                  "feature right context");
+  option.Register("cmvn-file", &feature_options.cmvn_file,
+                  "feature global cmvn file");
   option.Read(argc, argv);
   if (option.NumArgs() != 2) {
     option.PrintUsage();
@@ -30,12 +290,45 @@ int main(int argc, char *argv[]) {
   }
   std::string float_net_file = option.GetArg(1),
               quantize_net_file = option.GetArg(2);
+  if (per_row && calibration_scp != "" && !mixed) {
+    ERROR("--per-row doesn't use --calibration-scp");
+  }
+  if (mixed && calibration_scp == "") {
+    ERROR("--mixed needs --calibration-scp");
+  }
 
   Net net(float_net_file), quantize_net;
-  net.Quantize(&quantize_net);
+  if (calibration_scp != "") {
+    std::vector<std::string> keys;
+    std::vector<std::vector<float> > feats;
+    int dim = 0;
+    ReadFeatures(feature_options, calibration_scp, &keys, &feats, &dim);
+    std::vector<float> in_min, in_max;
+    Calibrate(net, feats, dim, &in_min, &in_max);
+    if (mixed) {
+      std::map<std::string, std::vector<int32_t> > alignments;
+      std::vector<const std::vector<int32_t>*> utt_alignments(keys.size(),
+                                                              NULL);
+      if (alignment_file != "") {
+        ReadAlignments(alignment_file, &alignments);
+        for (size_t i = 0; i < keys.size(); i++) {
+          if (alignments.find(keys[i]) != alignments.end()) {
+            utt_alignments[i] = &alignments[keys[i]];
+          }
+        }
+      }
+      MixedQuantize(net, feats, dim, utt_alignments, per_row, in_min, in_max,
+                    max_divergence, max_accuracy_loss, &quantize_net);
+    } else {
+      net.Quantize(in_min, in_max, &quantize_net);
+    }
+  } else if (per_row) {
+    net.QuantizePerRow(&quantize_net);
+  } else {
+    net.Quantize(&quantize_net);
+  }
   quantize_net.Write(quantize_net_file);
   quantize_net.Info();
 
   return 0;
 }
-
@@ -22,17 +22,22 @@
 #include "timer.h"
 #include "fst.h"
 #include "faster-decoder.h"
+#include "batch-decoder.h"
 #include "parse-option.h"
 
 int main(int argc, char* argv[]) {
   using xdecoder::ParseOptions;
+  using xdecoder::BatchDecoder;
   using xdecoder::FasterDecoder;
   using xdecoder::FasterDecoderOptions;
   using xdecoder::FeaturePipeline;
   using xdecoder::FeaturePipelineConfig;
   using xdecoder::Fst;
+  using xdecoder::CompressedFst;
+  using xdecoder::DecodeTrace;
   using xdecoder::Tree;
   using xdecoder::Net;
+  using xdecoder::NetWorkspace;
   using xdecoder::Vector;
   using xdecoder::SymbolTable;
   using xdecoder::OnlineDecodable;
@@ -50,6 +55,9 @@ int main(int argc, char* argv[]) {
                   "Decoding beam.  Larger->slower, more accurate.");
   option.Register("max-active", &decoder_options.max_active,
                  "Decoder max active states.  Larger->slower; more accurate");
+  option.Register("cutoff-bins", &decoder_options.cutoff_bins,
+                  "Histogram bins per beam for the max/min active cutoff, "
+                  "0 for exact cutoff.  Larger->slower; more accurate");
   option.Register("acoustic-scale", &decodable_options.acoustic_scale,
                   "Acoustic scale for decoding");
   option.Register("skip", &decodable_options.skip,
@@ -64,6 +72,18 @@ int main(int argc, char* argv[]) {
                   "feature right context");
   option.Register("cmvn-file", &feature_options.cmvn_file,
                   "feature global cmvn file");
+  int32_t num_streams = 1;
+  option.Register("num-streams", &num_streams,
+                  "Number of utterances decoded in lockstep, the net forward "
+                  "of them is batched, a stream takes the next utterance as "
+                  "soon as it finishes one");
+  bool use_huge_pages = false;
+  option.Register("use-huge-pages", &use_huge_pages,
+                  "Back the graph and the token pool with huge pages");
+  std::string trace_file = "";
+  option.Register("trace-file", &trace_file,
+                  "Write the counts of the active states and arcs to it, "
+                  "see fst-info");
   option.Read(argc, argv);
 
 
@@ -80,8 +100,25 @@ int main(int argc, char* argv[]) {
   std::string wav_scp_file = option.GetArg(6);
   std::string result_file = option.GetArg(7);
 
-  Fst fst(hclg_file);
+  // before the graph and the decoders are allocated
+  xdecoder::SetUseHugePages(use_huge_pages);
+  // hclg may be compressed by fst-compress
+  Fst fst;
+  CompressedFst compressed_fst;
+  bool compressed = CompressedFst::IsCompressedFst(hclg_file);
+  if (compressed) {
+    compressed_fst.Read(hclg_file);
+  } else {
+    fst.Read(hclg_file);
+  }
   Tree tree(tree_file);
+  // The decoder indexes the frame costs by ilabel without checking
+  int32_t max_ilabel = compressed ? compressed_fst.MaxIlabel() :
+                                    fst.MaxIlabel();
+  if (max_ilabel >= tree.NumTransitionIds()) {
+    ERROR("hclg ilabel %d out of the %d transition ids of the tree",
+          max_ilabel, tree.NumTransitionIds());
+  }
   Net net(net_file);
   Vector<float> pdf_prior;
   pdf_prior.Read(pdf_prior_file);
@@ -89,9 +126,30 @@ int main(int argc, char* argv[]) {
   SymbolTable words_table(word_file);
 
   FeaturePipeline feature_pipeline(feature_options);
+  NetWorkspace workspace;
   OnlineDecodable decodable(tree, pdf_prior, decodable_options,
-                            &net, &feature_pipeline);
-  FasterDecoder decoder(fst, decoder_options);
+                            &net, &workspace, &feature_pipeline);
+  FasterDecoder *decoder = NULL;
+  BatchDecoder *batch_decoder = NULL;
+  if (compressed) {
+    decoder = new FasterDecoder(compressed_fst, decoder_options);
+  } else {
+    decoder = new FasterDecoder(fst, decoder_options);
+  }
+  DecodeTrace trace;
+  if (trace_file != "") {
+    if (num_streams > 1) ERROR("trace is only for --num-streams=1");
+    decoder->SetTrace(&trace);
+  }
+  if (num_streams > 1 && compressed) {
+    batch_decoder = new BatchDecoder(compressed_fst, decoder_options, tree,
+                                     pdf_prior, decodable_options,
+                                     feature_options, net, num_streams);
+  } else if (num_streams > 1) {
+    batch_decoder = new BatchDecoder(fst, decoder_options, tree, pdf_prior,
+                                     decodable_options, feature_options,
+                                     net, num_streams);
+  }
 
   FILE *fin = fopen(wav_scp_file.c_str(), "r");
   if (!fin) {
@@ -104,48 +162,89 @@ int main(int argc, char* argv[]) {
   }
 
   double total_wav_time = 0.0, total_decoding_time = 0.0;
+  // counted by the sequential decoder only
+  int64_t total_frames = 0, total_active_toks = 0;
   char buffer[1024] = {0}, key[1024] = {0}, path[1024] = {0};
-  while (fgets(buffer, 1024, fin)) {
-    int num = sscanf(buffer, "%s %s", key, path);
-    if (num != 2) {
-      ERROR("each line shoud have 2 fields, key & wav path");
+  std::vector<std::string> keys;
+  std::vector<std::vector<float> > wavs;
+  // The batch decoder refills its streams within a Decode() call, so it
+  // gets many utterances per call and few streams idle at the end of it
+  int32_t wavs_per_decode = num_streams > 1 ? 16 * num_streams : 1;
+  bool eof = false;
+  while (!eof) {
+    if (fgets(buffer, 1024, fin)) {
+      int num = sscanf(buffer, "%s %s", key, path);
+      if (num != 2) {
+        ERROR("each line shoud have 2 fields, key & wav path");
+      }
+      WavReader wav_reader(path);
+      CHECK(wav_reader.NumChannel() == 1);
+      CHECK(wav_reader.SampleRate() == 16000);
+      keys.push_back(key);
+      wavs.push_back(std::vector<float>(wav_reader.Data(),
+          wav_reader.Data() + wav_reader.NumSample()));
+      if (static_cast<int32_t>(wavs.size()) < wavs_per_decode) continue;
+    } else {
+      eof = true;
+      if (wavs.size() == 0) break;
     }
-    WavReader wav_reader(path);
-    CHECK(wav_reader.NumChannel() == 1);
-    CHECK(wav_reader.SampleRate() == 16000);
-    std::vector<float> wav_data(wav_reader.Data(),
-                                wav_reader.Data() + wav_reader.NumSample());
-    double wav_time = static_cast<float>(wav_reader.NumSample()) /
-                      wav_reader.SampleRate();
-    Timer timer;
-    decodable.AcceptRawWav(wav_data);
-    decodable.SetDone();
 
-    std::vector<int32_t> result;
-    decoder.Decode(&decodable);
-    decoder.GetBestPath(&result);
+    double wav_time = 0.0;
+    for (size_t i = 0; i < wavs.size(); i++) {
+      // all wavs are 16k, see the check above
+      wav_time += static_cast<float>(wavs[i].size()) / 16000;
+    }
+    Timer timer;
+    std::vector<std::vector<int32_t> > results;
+    if (batch_decoder != NULL) {
+      batch_decoder->Decode(wavs, &results);
+    } else {
+      CHECK(wavs.size() == 1);
+      results.resize(1);
+      decodable.AcceptRawWav(wavs[0]);
+      decodable.SetDone();
+      decoder->Decode(&decodable);
+      decoder->GetBestPath(&results[0]);
+      total_frames += decoder->NumFramesDecoded();
+      total_active_toks += decoder->NumActiveTokens();
+      // Reset all
+      decodable.Reset();
+    }
     double decode_time = timer.Elapsed();
 
-    std::ostringstream ss;
-    ss << key;
-    for (size_t i = 0; i < result.size(); i++) {
-      ss << " " << words_table.GetSymbol(result[i]);
+    for (size_t i = 0; i < results.size(); i++) {
+      std::ostringstream ss;
+      ss << keys[i];
+      for (size_t j = 0; j < results[i].size(); j++) {
+        ss << " " << words_table.GetSymbol(results[i][j]);
+      }
+      LOG("%s", ss.str().c_str());
+      fprintf(fout, "%s\n", ss.str().c_str());
     }
-    LOG("%s", ss.str().c_str());
     LOG("wav %lf decode %lf rtf %lf", wav_time, decode_time,
                                       decode_time / wav_time);
-    fprintf(fout, "%s\n", ss.str().c_str());
     total_wav_time += wav_time;
     total_decoding_time += decode_time;
-
-    // Reset all
-    decodable.Reset();
+    keys.clear();
+    wavs.clear();
   }
 
   LOG("Total RTF %lf", total_decoding_time / total_wav_time);
+  if (total_frames > 0) {
+    LOG("Average active tokens per frame %lf",
+        static_cast<double>(total_active_toks) / total_frames);
+  }
+  if (trace_file != "") trace.Write(trace_file);
+  if (use_huge_pages) {
+    LOG("%s", compressed ? compressed_fst.HugePageReport().c_str() :
+                           fst.HugePageReport().c_str());
+    LOG("token pool %s", decoder->TokenPoolReport().c_str());
+  }
 
   fclose(fin);
   fclose(fout);
+  if (batch_decoder != NULL) delete batch_decoder;
+  delete decoder;
 
   return 0;
 }